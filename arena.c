@@ -0,0 +1,103 @@
+/*
+ * $Id$
+ *
+ * arenas for parsed crontabs.
+ *
+ * The user structure and the entries of a crontab, with the strings
+ * and tables hanging off them, are allocated from an arena belonging
+ * to the user. The arena is a list of chunks memory is handed out from
+ * in order, so that the entries of a crontab lie next to each other,
+ * and nothing is freed piece by piece: when the crontab is reloaded or
+ * removed, all of it goes back in one go with arena_free().
+ */
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define ARENA_CHUNK 8192	/*- usual size of a chunk */
+#define ARENA_ALIGN 16		/*- alignment of everything handed out */
+#define ALIGNED(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+static arena_chunk *
+chunk_new(size_t size)
+{
+	arena_chunk    *c;
+
+	if (!(c = (arena_chunk *) malloc(ALIGNED(sizeof (arena_chunk)) + size)))
+		return (NULL);
+	c->size = size;
+	c->used = 0;
+	c->next = NULL;
+	return (c);
+}
+
+/*-
+ * return n bytes of zeroed memory from a. a request too large to leave
+ * much of a chunk gets a chunk of its own, put behind the one in use.
+ * returns NULL when out of memory.
+ */
+void           *
+arena_alloc(arena *a, size_t n)
+{
+	arena_chunk    *c;
+	char           *p;
+
+	n = ALIGNED(n ? n : 1);
+	if (n > ARENA_CHUNK / 4) {
+		if (!(c = chunk_new(n)))
+			return (NULL);
+		if (a->chunk) {
+			c->next = a->chunk->next;
+			a->chunk->next = c;
+		} else
+			a->chunk = c;
+	} else
+	if (!(c = a->chunk) || c->size - c->used < n) {
+		if (!(c = chunk_new(ARENA_CHUNK)))
+			return (NULL);
+		c->next = a->chunk;
+		a->chunk = c;
+	}
+	p = (char *) c + ALIGNED(sizeof (arena_chunk)) + c->used;
+	c->used += n;
+	return (memset(p, 0, n));
+}
+
+char           *
+arena_strdup(arena *a, const char *s)
+{
+	size_t          n = strlen(s) + 1;
+	char           *p;
+
+	if (!(p = (char *) arena_alloc(a, n)))
+		return (NULL);
+	return (memcpy(p, s, n));
+}
+
+/*-
+ * give back all memory of a. a itself may live in the arena, so the
+ * list of chunks is taken from it first.
+ */
+void
+arena_free(arena *a)
+{
+	arena_chunk    *c, *next;
+
+	for (c = a->chunk; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+}
+
+void
+getversion_arena_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
@@ -0,0 +1,244 @@
+/*
+ * $Id$
+ *
+ * day maps for the L, W and # terms and EXCLUDE files.
+ *
+ * The day fields of an entry may use terms which do not stand for a
+ * fixed day of the month or of the week: L (last day of the month), LW
+ * (last weekday), nW (weekday nearest to day n), nL (last day of week n
+ * in the month) and n#k (k-th day of week n in the month). An EXCLUDE
+ * file lists dates on which the entry does not run. For such entries
+ * the days of a year are worked out once and kept as a bit map, so that
+ * deciding whether an entry runs on a day stays a single bit test. The
+ * map is rebuilt when a day of another year is looked at. An EXCLUDE
+ * file is read once for the entries of a crontab which follow it, with
+ * the rights of the crontab owner.
+ */
+#include <strerr.h>
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+
+#define EXCLUDE_MAX 65536	/*- largest EXCLUDE file, in bytes */
+
+static exclude *excl_last;	/*- the last EXCLUDE file read */
+
+static int      mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static int
+is_leap(int year)
+{
+	return ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0);
+}
+
+/*- day of the week of 1 January of year, 0 is Sunday */
+static int
+jan1_dow(int year)
+{
+	int             y = year - 1;
+
+	return ((1 + 5 * (y % 4) + 4 * (y % 100) + 6 * (y % 400)) % 7);
+}
+
+/*- the weekday nearest to day n of a month of len days starting on dow1 */
+static int
+nearest_weekday(int n, int len, int dow1)
+{
+	int             dow = (dow1 + n - 1) % 7;
+
+	if (dow == 6)		/*- Saturday, take Friday unless it is in the month before */
+		return (n > 1 ? n - 1 : n + 2);
+	if (dow == 0)		/*- Sunday, take Monday unless it is in the month after */
+		return (n < len ? n + 1 : n - 2);
+	return (n);
+}
+
+/*-
+ * build the map of the days of year on which the entry e runs into
+ * c->days. day fields are combined as in day_match(), and the dates
+ * of the EXCLUDE file are taken out.
+ */
+void
+calendar_build(calendar *c, const entry *e, int year)
+{
+	int             m, d, len, dow1, dow, yday, lastwd, i;
+	bool            thisdom, thisdow;
+
+	bit_nclear(c->days, 0, YEARDAY_COUNT - 1);
+	dow1 = jan1_dow(year);
+	for (m = 0, yday = 0; m < 12; m++) {
+		len = mdays[m] + (m == 1 && is_leap(year));
+		for (lastwd = len; (dow1 + lastwd - 1) % 7 == 0 || (dow1 + lastwd - 1) % 7 == 6; lastwd--)
+			;
+		for (d = 1; d <= len; d++, yday++) {
+			dow = (dow1 + d - 1) % 7;
+			thisdom = bit_test(e->dom, d - FIRST_DOM) || (d == len && (e->flags & DOM_LAST)) ||
+				(c->lastweekday && d == lastwd);
+			for (i = FIRST_DOM; !thisdom && i <= len; i++)
+				thisdom = bit_test(c->nearest, i - FIRST_DOM) && nearest_weekday(i, len, dow1) == d;
+			thisdow = bit_test(e->dow, dow) || ((c->lastdow & (1 << dow)) && d + 7 > len) ||
+				(c->nthdow[(d - 1) / 7] & (1 << dow));
+			if ((e->flags & (DOM_STAR | DOW_STAR)) != 0 ? (thisdom && thisdow) : (thisdom || thisdow))
+				bit_set(c->days, yday);
+		}
+		dow1 = (dow1 + len) % 7;
+	}
+	for (i = 0; c->excl && i < c->excl->ndates; i++) {
+		if (c->excl->dates[i] / 10000 && c->excl->dates[i] / 10000 != year)
+			continue;
+		m = c->excl->dates[i] / 100 % 100 - 1;
+		d = c->excl->dates[i] % 100;
+		if (d > mdays[m] + (m == 1 && is_leap(year)))
+			continue;	/*- 29 Feb of a year which has none */
+		for (yday = d - 1; m--;)
+			yday += mdays[m] + (m == 1 && is_leap(year));
+		bit_clear(c->days, yday);
+	}
+	c->year = year;
+}
+
+void
+exclude_put(exclude *x)
+{
+	if (!x || --x->refs)
+		return;
+	free(x->path);
+	free(x->dates);
+	free(x);
+}
+
+/*-
+ * open path for reading with the rights of pw, so that a crontab can
+ * only name a file its owner may read. O_NONBLOCK keeps a FIFO from
+ * holding up svcron, it is cleared once the file is known to be a
+ * regular file.
+ */
+static int
+open_as(const char *path, const struct passwd *pw)
+{
+	gid_t          *groups, egid;
+	int             ngroups, fd, save_errno;
+
+	if (geteuid() || !pw->pw_uid)
+		return (open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC));
+	if ((ngroups = getgroups(0, NULL)) == -1)
+		return (-1);
+	if (!(groups = (gid_t *) malloc((ngroups + 1) * sizeof (gid_t))))
+		die_nomem(FATAL);
+	if ((ngroups = getgroups(ngroups, groups)) == -1) {
+		free(groups);
+		return (-1);
+	}
+	egid = getegid();
+	if (initgroups(pw->pw_name, pw->pw_gid) == -1 || setegid(pw->pw_gid) == -1 || seteuid(pw->pw_uid) == -1)
+		fd = -1;
+	else
+		fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+	save_errno = errno;
+	if (seteuid(ROOT_UID) == -1 || setegid(egid) == -1 || setgroups(ngroups, groups) == -1)
+		strerr_die2sys(111, FATAL, "unable to switch back to root: ");
+	free(groups);
+	errno = save_errno;
+	return (fd);
+}
+
+/*-
+ * read the dates of the EXCLUDE file path, one per line as YYYY-MM-DD
+ * or, for a date of every year, MM-DD. blank lines and lines starting
+ * with # are skipped. the file must be a regular file of at most
+ * EXCLUDE_MAX bytes which pw may read. the dates are shared with the
+ * entries after this one naming the same file for the same user, until
+ * calendar_flush() is called at the end of the crontab.
+ * return -1 on error
+ */
+int
+calendar_exclude(calendar *c, const char *path, const struct passwd *pw)
+{
+	FILE           *fp;
+	exclude        *x;
+	struct stat     st;
+	char            line[MAX_TEMPSTR], *p;
+	int             fd, y, m, d, n, *dates;
+
+	if ((x = excl_last) && x->uid == pw->pw_uid && !strcmp(x->path, path)) {
+		x->refs++;
+		c->excl = x;
+		return (0);
+	}
+	if (*path != '/' || (fd = open_as(path, pw)) == -1)
+		return (-1);
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size > EXCLUDE_MAX ||
+			fcntl(fd, F_SETFL, O_RDONLY) == -1 || !(fp = fdopen(fd, "r"))) {
+		close(fd);
+		return (-1);
+	}
+	if (!(x = (exclude *) calloc(1, sizeof (exclude))) || !(x->path = strdup(path))) {
+		free(x);
+		fclose(fp);
+		return (-1);
+	}
+	x->uid = pw->pw_uid;
+	x->refs = 1;
+	c->excl = x; /*- freed with c on error */
+	while (fgets(line, sizeof (line), fp)) {
+		for (p = line; Is_Blank(*p); p++)
+			;
+		if (*p == '#' || *p == '\n' || !*p)
+			continue;
+		y = 0;
+		if (sscanf(p, "%4d-%2d-%2d%n", &y, &m, &d, &n) != 3 &&
+				(y = 0, sscanf(p, "%2d-%2d%n", &m, &d, &n) != 2))
+			break;
+		for (p += n; Is_Blank(*p) || *p == '\n'; p++)
+			;
+		if (*p || y < 0 || m < 1 || m > 12 || d < 1 || d > mdays[m - 1] + (m == 2))
+			break;
+		if (!(x->ndates % 16)) {
+			if (!(dates = (int *) realloc(x->dates, (x->ndates + 16) * sizeof (int))))
+				break;
+			x->dates = dates;
+		}
+		x->dates[x->ndates++] = y * 10000 + m * 100 + d;
+	}
+	if (ferror(fp) || !feof(fp)) {
+		fclose(fp);
+		return (-1);
+	}
+	fclose(fp);
+	exclude_put(excl_last);
+	excl_last = x;
+	x->refs++;
+	return (0);
+}
+
+/*- forget the last EXCLUDE file read, once a crontab has been loaded */
+void
+calendar_flush(void)
+{
+	exclude_put(excl_last);
+	excl_last = NULL;
+}
+
+void
+calendar_free(calendar *c)
+{
+	if (!c)
+		return;
+	exclude_put(c->excl);
+	free(c);
+}
+
+void
+getversion_calendar_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
@@ -0,0 +1,254 @@
+/*
+ * $Id$
+ *
+ * cgroup v2 placement and resource limits for cron jobs.
+ *
+ * When svcron is started with -c cgroup_dir, every job runs in a cgroup
+ * of its own, created as
+ *
+ *   cgroup_dir/username/pid
+ *
+ * where pid is the pid of the process which supervises the job (the
+ * child of svcron). The per user cgroup aggregates the usage of all jobs
+ * of that user and has the memory, cpu, io and pids controllers enabled
+ * for its children. The per job cgroup gets the limits set by
+ * CRON_MEMORY_MAX, CRON_CPU_WEIGHT, CRON_IO_WEIGHT and CRON_PIDS_MAX in
+ * the crontab. The grandchild is spawned directly into the job cgroup
+ * using clone3() with CLONE_INTO_CGROUP, so there is no window where the
+ * job runs outside its cgroup. When the job exits, its cpu, memory and io
+ * usage is read back from the cgroup and the cgroup is removed.
+ */
+#include <stralloc.h>
+#include <strerr.h>
+#include <fmt.h>
+#include <subfd.h>
+#include <qprintf.h>
+#include "cron.h"
+#ifdef LINUX
+#include <sys/syscall.h>
+#include <linux/sched.h>
+#endif
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+#define WARN  "svcron: warn: "
+
+#if defined(LINUX) && defined(CLONE_INTO_CGROUP) && defined(SYS_clone3)
+#define HAVE_CLONE3
+#endif
+
+static const char *controllers[] = { "+memory", "+cpu", "+io", "+pids", NULL };
+static stralloc path = { 0 };
+
+static int
+cg_write(int dirfd, const char *file, const char *value)
+{
+	int             fd, r;
+
+	if ((fd = openat(dirfd, file, O_WRONLY | O_CLOEXEC)) == -1)
+		return (-1);
+	r = write(fd, value, strlen(value));
+	close(fd);
+	return (r == -1 ? -1 : 0);
+}
+
+static int
+cg_read(int dirfd, const char *file, char *buf, int len)
+{
+	int             fd, n;
+
+	if ((fd = openat(dirfd, file, O_RDONLY | O_CLOEXEC)) == -1)
+		return (-1);
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n == -1)
+		return (-1);
+	buf[n] = 0;
+	return (n);
+}
+
+/*
+ * enable controllers for the children of dirfd. Controllers not
+ * available in the parent are silently skipped.
+ */
+static void
+cg_enable(int dirfd)
+{
+	const char    **p;
+
+	for (p = controllers; *p; p++)
+		(void) cg_write(dirfd, "cgroup.subtree_control", *p);
+}
+
+/*
+ * called once at startup. create the root cgroup for svcron and
+ * enable controllers for the per user cgroups.
+ */
+int
+cgroup_init(const char *root)
+{
+	int             fd;
+
+	if (mkdir(root, 0755) == -1 && errno != EEXIST) {
+		strerr_warn4(WARN, "unable to create cgroup ", root, ": ", &strerr_sys);
+		return (-1);
+	}
+	if ((fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		strerr_warn4(WARN, "unable to open cgroup ", root, ": ", &strerr_sys);
+		return (-1);
+	}
+	if (faccessat(fd, "cgroup.procs", F_OK, 0) == -1) {
+		strerr_warn3(WARN, root, ": not a cgroup v2 directory", 0);
+		close(fd);
+		return (-1);
+	}
+	cg_enable(fd);
+	close(fd);
+	return (0);
+}
+
+/*
+ * create the job cgroup CgroupRoot/usernm/id and apply the limits of e.
+ * returns a descriptor for the cgroup directory, suitable for
+ * cgroup_fork(), or -1 if the job has to run without a cgroup.
+ */
+int
+cgroup_open(const entry *e, const char *usernm, pid_t id)
+{
+	int             ufd, fd;
+	char            strnum[FMT_ULONG];
+
+	if (!qsprintf(&path, "%s/%s", CgroupRoot, usernm))
+		die_nomem(FATAL);
+	if (mkdir(path.s, 0755) == -1 && errno != EEXIST) {
+		strerr_warn4(WARN, "unable to create cgroup ", path.s, ": ", &strerr_sys);
+		return (-1);
+	}
+	if ((ufd = open(path.s, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		strerr_warn4(WARN, "unable to open cgroup ", path.s, ": ", &strerr_sys);
+		return (-1);
+	}
+	cg_enable(ufd);
+	close(ufd);
+	if (!qsprintf(&path, "%s/%s/%d", CgroupRoot, usernm, id))
+		die_nomem(FATAL);
+	if (mkdir(path.s, 0755) == -1 && errno != EEXIST) {
+		strerr_warn4(WARN, "unable to create cgroup ", path.s, ": ", &strerr_sys);
+		return (-1);
+	}
+	if ((fd = open(path.s, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		strerr_warn4(WARN, "unable to open cgroup ", path.s, ": ", &strerr_sys);
+		(void) rmdir(path.s);
+		return (-1);
+	}
+	if (e->mem_max) {
+		strnum[fmt_ulong(strnum, e->mem_max)] = 0;
+		if (cg_write(fd, "memory.max", strnum) == -1)
+			strerr_warn6(WARN, "unable to set ", path.s, "/memory.max to ", strnum, ": ", &strerr_sys);
+	}
+	if (e->cpu_weight) {
+		strnum[fmt_ulong(strnum, e->cpu_weight)] = 0;
+		if (cg_write(fd, "cpu.weight", strnum) == -1)
+			strerr_warn6(WARN, "unable to set ", path.s, "/cpu.weight to ", strnum, ": ", &strerr_sys);
+	}
+	if (e->io_weight) {
+		strnum[fmt_ulong(strnum, e->io_weight)] = 0;
+		if (cg_write(fd, "io.weight", strnum) == -1)
+			strerr_warn6(WARN, "unable to set ", path.s, "/io.weight to ", strnum, ": ", &strerr_sys);
+	}
+	if (e->pids_max) {
+		strnum[fmt_ulong(strnum, e->pids_max)] = 0;
+		if (cg_write(fd, "pids.max", strnum) == -1)
+			strerr_warn6(WARN, "unable to set ", path.s, "/pids.max to ", strnum, ": ", &strerr_sys);
+	}
+	return (fd);
+}
+
+/*
+ * fork a child directly into the cgroup cgfd. Falls back to fork()
+ * followed by a write to cgroup.procs when the kernel lacks clone3() or
+ * CLONE_INTO_CGROUP. Returns like fork().
+ */
+pid_t
+cgroup_fork(int cgfd)
+{
+	pid_t           pid;
+#ifdef HAVE_CLONE3
+	struct clone_args args;
+
+	bzero((char *) &args, sizeof (args));
+	args.flags = CLONE_INTO_CGROUP;
+	args.exit_signal = SIGCHLD;
+	args.cgroup = cgfd;
+	if ((pid = syscall(SYS_clone3, &args, sizeof (args))) != -1 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL))
+		return (pid);
+#endif
+	if ((pid = fork()) == 0 && cg_write(cgfd, "cgroup.procs", "0") == -1)
+		strerr_warn2(WARN, "unable to join job cgroup: ", &strerr_sys);
+	return (pid);
+}
+
+static unsigned long
+cg_value(const char *buf, const char *key)
+{
+	const char     *p;
+	int             len = strlen(key);
+
+	for (p = buf; (p = strstr(p, key)); p += len) {
+		if ((p == buf || p[-1] == ' ' || p[-1] == '\n') && p[len] == ' ')
+			return (strtoul(p + len + 1, NULL, 10));
+	}
+	return (0);
+}
+
+/*
+ * read back the accounting of the job cgroup, log it and remove the
+ * cgroup. Called after all processes of the job have been reaped.
+ */
+void
+cgroup_close(const char *usernm, int cgfd)
+{
+	char            buf[4096];
+	char           *p;
+	unsigned long   usage = 0, user = 0, sys = 0, peak = 0, rbytes = 0, wbytes = 0;
+
+	if (cg_read(cgfd, "cpu.stat", buf, sizeof (buf)) > 0) {
+		usage = cg_value(buf, "usage_usec");
+		user = cg_value(buf, "user_usec");
+		sys = cg_value(buf, "system_usec");
+	}
+	if (cg_read(cgfd, "memory.peak", buf, sizeof (buf)) > 0)
+		peak = strtoul(buf, NULL, 10);
+	if (cg_read(cgfd, "io.stat", buf, sizeof (buf)) > 0) {
+		for (p = buf; (p = strstr(p, "rbytes=")); p += 7)
+			rbytes += strtoul(p + 7, NULL, 10);
+		for (p = buf; (p = strstr(p, "wbytes=")); p += 7)
+			wbytes += strtoul(p + 7, NULL, 10);
+	}
+	close(cgfd);
+	if (verbose) {
+		if (subprintf(subfderr, "%s: cgroup     %s: user %s cpu %lu.%06lus user %lu.%06lus sys %lu.%06lus mem.peak %lu io.rbytes %lu io.wbytes %lu\n",
+				ProgramName, path.s, usernm, usage / 1000000, usage % 1000000, user / 1000000, user % 1000000,
+				sys / 1000000, sys % 1000000, peak, rbytes, wbytes) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+		if (substdio_flush(subfderr) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	}
+	/*- processes left behind by the job keep the cgroup busy */
+	if (rmdir(path.s) == -1 && errno != ENOENT)
+		strerr_warn4(WARN, "unable to remove cgroup ", path.s, ": ", &strerr_sys);
+}
+
+void
+getversion_cgroup_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
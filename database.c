@@ -53,13 +53,58 @@ is_greater_than(time_t left, time_t right)
 }
 #endif
 
+/*-
+ * a reload of the crontabs under way. the crontabs found are loaded
+ * into tabs, in the order found, while the database in use is left as
+ * it is and jobs keep being run from it. load_database() does this a
+ * slice at a time, and the database is only changed by reload_finish()
+ * at the end, so that a large reload does not hold up the jobs of a
+ * minute.
+ */
+#define RL_IDLE      0
+#define RL_SYSCRONTAB 1
+#define RL_SPOOL     2
+#define RL_CROND     3
+
+static struct {
+	int             stage;
+	unsigned int    pass;		/*- number of the reload, see user.seen */
+	DIR            *dir;		/*- directory being read */
+	bool            syscron;	/*- SYSCRONTAB is to be read */
+#ifdef LINUX
+	struct timespec mtim;		/*- for the new database */
+#else
+	time_t          mtime;
+#endif
+	struct loaded {
+		user           *u;	/*- the crontab as loaded now, NULL if it failed to load */
+		user           *old;	/*- its previous version, NULL if none */
+	}              *tabs;
+	int             ntabs, atabs;
+} rl;
+
+static void
+reload_add(user *u, user *old)
+{
+	struct loaded  *t;
+
+	if (rl.ntabs == rl.atabs) {
+		if (!(t = (struct loaded *) realloc(rl.tabs, (rl.atabs + 64) * sizeof (struct loaded))))
+			die_nomem(FATAL);
+		rl.tabs = t;
+		rl.atabs += 64;
+	}
+	rl.tabs[rl.ntabs].u = u;
+	rl.tabs[rl.ntabs++].old = old;
+}
+
 static void
 process_crontab(const char *uname, const char *fname, const char *tabname,
-		struct stat *statbuf, cron_db *new_db, cron_db *old_db)
+		struct stat *statbuf, cron_db *db)
 {
 	struct passwd  *pw = NULL;
 	int             crontab_fd = OK - 1;
-	user           *u;
+	user           *u, *nu;
 
 	if (fname == NULL)	 /*- must be set to something for logging purposes. */
 		fname = "*system*";
@@ -95,8 +140,13 @@ process_crontab(const char *uname, const char *fname, const char *tabname,
 		goto next_crontab;
 	}
 
-	u = find_user(old_db, fname);
+	/*- the crontab in use by this name, if not taken by this reload yet */
+	for (u = db->head; u != NULL; u = u->next) {
+		if (u->seen != rl.pass && strcmp(u->name, fname) == 0)
+			break;
+	}
 	if (u != NULL) {
+		u->seen = rl.pass;
 		/*
 		 * if crontab has not changed since we last read it
 		 * in, then we can just use our existing entry.
@@ -106,32 +156,27 @@ process_crontab(const char *uname, const char *fname, const char *tabname,
 #else
 		if (TEQUAL(u->mtime, statbuf->st_mtime)) {
 #endif
-			unlink_user(old_db, u);
-			link_user(new_db, u);
+			reload_add(u, NULL);
 			goto next_crontab;
 		}
 
 		/*
-		 * before we fall through to the code that will reload
-		 * the user, let's deallocate and unlink the user in
-		 * the old database. This is more a point of memory
-		 * efficiency than anything else, since all leftover
-		 * users will be deleted from the old database when
-		 * we finish with the crontab...
+		 * the previous version stays in use until the reload is
+		 * finished, and is replaced then, see reload_finish().
 		 */
-		unlink_user(old_db, u);
-		free_user(u);
 		log_it1(fname, getpid(), "RELOAD", tabname, 0);
 	}
-	u = load_user(crontab_fd, pw, fname);
-	if (u != NULL) {
+	nu = load_user(crontab_fd, pw, fname);
+	if (nu != NULL) {
 #ifdef LINUX
-		u->mtim = statbuf->st_mtim;
+		nu->mtim = statbuf->st_mtim;
 #else
-		u->mtime = statbuf->st_mtime;
+		nu->mtime = statbuf->st_mtime;
 #endif
-		link_user(new_db, u);
-	}
+		reload_add(nu, u);
+	} else
+	if (u != NULL)
+		reload_add(NULL, u);
 
 next_crontab:
 	if (crontab_fd >= OK) {
@@ -139,23 +184,83 @@ next_crontab:
 	}
 }
 
-void
-load_database(cron_db *old_db, char *dbdir)
+/*-
+ * put the crontabs loaded by the reload in place of the database in
+ * use. the entries of a reloaded crontab take over the run time state
+ * of the entries they replace.
+ */
+static void
+reload_finish(cron_db *db)
 {
-	struct stat     spool_stat, syscron_stat, crond_stat;
-	cron_db         new_db;
-	struct dirent  *dp;
-	DIR            *dir;
 	user           *u, *nu;
-	char           *spool_dir;
+	int             i;
+
+	/*
+	 * if we don't do this, then when our children eventually call
+	 * getpwnam() in do_command.c's child_process to verify MAILTO=,
+	 * they will screw us up (and v-v).
+	 */
+	endpwent();
+
+	/*- whatever the reload has not found again is now junk. */
+	for (u = db->head; u != NULL; u = nu) {
+		nu = u->next;
+		if (u->seen != rl.pass)
+			free_user(u);
+	}
+	db->head = db->tail = NULL;
+	for (i = 0; i < rl.ntabs; i++) {
+		if (rl.tabs[i].old) {
+			if (rl.tabs[i].u)
+				carry_user(rl.tabs[i].old, rl.tabs[i].u);
+			free_user(rl.tabs[i].old);
+		}
+		if (rl.tabs[i].u)
+			link_user(db, rl.tabs[i].u);
+	}
+	sched_free(db);
+#ifdef LINUX
+	db->mtim = rl.mtim;
+#else
+	db->mtime = rl.mtime;
+#endif
+	rl.stage = RL_IDLE;
+}
+
+static long
+elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+/*-
+ * reload the crontabs if any has changed. the reload is done at most
+ * slice milliseconds at a time, all at once when slice is 0, and is
+ * carried on by the next call. returns DB_LOADING while a reload is
+ * under way, DB_RELOADED when it has been finished by this call and
+ * DB_UNCHANGED when no crontab has changed.
+ */
+int
+load_database(cron_db *old_db, char *dbdir, int slice)
+{
+	struct stat     spool_stat, syscron_stat, crond_stat, statbuf;
+	struct dirent  *dp;
+	struct timespec start;
+	char           *spool_dir, *dirname;
 	static stralloc tabname = {0}, fname = {0};
 
+	spool_dir = dbdir ? dbdir : SPOOL_DIR;
+	if (rl.stage != RL_IDLE)
+		goto resume;
+
 	/*-
 	 * before we start loading any data, do a stat on spool_dir
 	 * so that if anything changes as of this moment (i.e., before we've
 	 * cached any of the database), we'll see the changes next time.
 	 */
-	spool_dir = dbdir ? dbdir : SPOOL_DIR;
 	if (stat(spool_dir, &spool_stat) < OK)
 #ifdef LINUX
 		spool_stat.st_mtim = ts_zero;
@@ -207,91 +312,86 @@ load_database(cron_db *old_db, char *dbdir)
 #else
 	if (TEQUAL(old_db->mtime, TMAX(crond_stat.st_mtime, TMAX(spool_stat.st_mtime, syscron_stat.st_mtime))))
 #endif
-		return;
+		return (DB_UNCHANGED);
 
 	/*
-	 * something's different. make a new database, moving unchanged
+	 * something's different. make a new database, taking unchanged
 	 * elements from the old database, reloading elements that have
 	 * actually changed. Whatever is left in the old database when
 	 * we're done is chaff -- crontabs that disappeared.
 	 */
 #ifdef LINUX
-	new_db.mtim = TMAX(spool_stat.st_mtim, syscron_stat.st_mtim);
+	rl.mtim = TMAX(spool_stat.st_mtim, syscron_stat.st_mtim);
+	rl.syscron = !dbdir && !TEQUAL(syscron_stat.st_mtim, ts_zero);
 #else
-	new_db.mtime = TMAX(spool_stat.st_mtime, syscron_stat.st_mtime);
+	rl.mtime = TMAX(spool_stat.st_mtime, syscron_stat.st_mtime);
+	rl.syscron = !dbdir && !TEQUAL(syscron_stat.st_mtime, ts_zero);
 #endif
-	new_db.head = new_db.tail = NULL;
+	rl.pass++;
+	rl.ntabs = 0;
+	rl.stage = RL_SYSCRONTAB;
 
-#ifdef LINUX
-	if (!dbdir && !TEQUAL(syscron_stat.st_mtim, ts_zero))
-#else
-	if (!dbdir && !TEQUAL(syscron_stat.st_mtime, ts_zero))
+resume:
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		switch (rl.stage)
+		{
+		case RL_SYSCRONTAB:
+#ifdef SYSCRONTAB
+			if (rl.syscron)
+				process_crontab("root", NULL, SYSCRONTAB, &statbuf, old_db);
 #endif
-		process_crontab("root", NULL, SYSCRONTAB, &syscron_stat, &new_db, old_db);
-
-	/*
-	 * we used to keep this dir open all the time, for the sake of
-	 * efficiency. however, we need to close it in every fork, and
-	 * we fork a lot more often than the mtime of the dir changes.
-	 */
-	if (!(dir = opendir(spool_dir)))
-		goto next;
-
-	while (NULL != (dp = readdir(dir))) {
-		/*
-		 * avoid file names beginning with ".". this is good
-		 * because we would otherwise waste two guaranteed calls
-		 * to getpwnam() for . and .., and also because user names
-		 * starting with a period are just too nasty to consider.
-		 */
-		if (dp->d_name[0] == '.')
-			continue;
-		if (!stralloc_copys(&fname, dp->d_name) ||
-				!stralloc_0(&fname))
-			die_nomem(FATAL);
-		if (!stralloc_copys(&tabname, spool_dir) ||
-				!stralloc_append(&tabname, "/") ||
-				!stralloc_cat(&tabname, &fname))
-			die_nomem(FATAL);
-		process_crontab(fname.s, fname.s, tabname.s, &crond_stat, &new_db, old_db);
-	}
-	closedir(dir);
-next:
+			/*
+			 * we used to keep this dir open all the time, for the sake of
+			 * efficiency. however, we need to close it in every fork, and
+			 * we fork a lot more often than the mtime of the dir changes.
+			 * it is only kept open, close-on-exec, while a reload is
+			 * under way.
+			 */
+			rl.dir = opendir(spool_dir);
+			rl.stage = RL_SPOOL;
+			break;
+		case RL_SPOOL:
+		case RL_CROND:
+			if (!rl.dir || !(dp = readdir(rl.dir))) {
+				if (rl.dir)
+					closedir(rl.dir);
+				rl.dir = NULL;
 #ifdef SYS_CROND_DIR
-	if (!(dir = opendir(SYS_CROND_DIR)))
-		goto end;
-	while (NULL != (dp = readdir(dir))) {
-		if (dp->d_name[0] == '.')
-			continue;
-		if (!stralloc_copys(&fname, dp->d_name) ||
-				!stralloc_0(&fname))
-			die_nomem(FATAL);
-		if (!stralloc_copys(&tabname, SYS_CROND_DIR) ||
-				!stralloc_append(&tabname, "/") ||
-				!stralloc_cat(&tabname, &fname))
-			die_nomem(FATAL);
-		process_crontab(fname.s, fname.s, tabname.s, &spool_stat, &new_db, old_db);
-	}
-	closedir(dir);
+				if (rl.stage == RL_SPOOL) {
+					rl.dir = opendir(SYS_CROND_DIR);
+					rl.stage = RL_CROND;
+					break;
+				}
 #endif
-
-end:
-	/*
-	 * if we don't do this, then when our children eventually call
-	 * getpwnam() in do_command.c's child_process to verify MAILTO=,
-	 * they will screw us up (and v-v).
-	 */
-	endpwent();
-
-	/*- whatever's left in the old database is now junk. */
-	for (u = old_db->head; u != NULL; u = nu) {
-		nu = u->next;
-		unlink_user(old_db, u);
-		free_user(u);
-	}
-
-	/*- overwrite the database control block with the new one. */
-	*old_db = new_db;
+				reload_finish(old_db);
+				return (DB_RELOADED);
+			}
+			/*
+			 * avoid file names beginning with ".". this is good
+			 * because we would otherwise waste two guaranteed calls
+			 * to getpwnam() for . and .., and also because user names
+			 * starting with a period are just too nasty to consider.
+			 */
+			if (dp->d_name[0] == '.')
+				break;
+#ifdef SYS_CROND_DIR
+			dirname = rl.stage == RL_SPOOL ? spool_dir : SYS_CROND_DIR;
+#else
+			dirname = spool_dir;
+#endif
+			if (!stralloc_copys(&fname, dp->d_name) ||
+					!stralloc_0(&fname))
+				die_nomem(FATAL);
+			if (!stralloc_copys(&tabname, dirname) ||
+					!stralloc_append(&tabname, "/") ||
+					!stralloc_cat(&tabname, &fname))
+				die_nomem(FATAL);
+			process_crontab(fname.s, fname.s, tabname.s, &statbuf, old_db);
+			break;
+		}
+	} while (!slice || elapsed_ms(&start) < slice);
+	return (DB_LOADING);
 }
 
 void
@@ -16,6 +16,9 @@
  * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef LINUX
+#define _GNU_SOURCE
+#endif
 #include <sig.h>
 #include <substdio.h>
 #include <subfd.h>
@@ -24,6 +27,13 @@
 #include <qprintf.h>
 #include <error.h>
 #include "cron.h"
+#include <sys/resource.h>
+#include <limits.h>
+#ifdef LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
 #define FATAL "svcron: fatal: "
 #define WARN  "svcron: warn: "
 
@@ -31,12 +41,163 @@
 static char     rcsid[] = "$Id: do_command.c,v 1.4 2026-07-07 17:43:13+05:30 Cprogrammer Exp mbhangui $";
 #endif
 
-static void     child_process(entry *, const user *);
-static int      safe_p(const char *, const char *);
+static void     child_process(entry *, const user *, time_t, int, int);
+static void     set_sched(const entry *);
+static void     exec_direct(const entry *);
+
+/*-
+ * jobs started ahead of their time with svcron -p wait on this pipe
+ * just before exec. barrier_release() closes the write end at the
+ * minute, and all of them see EOF at once. every child of svcron
+ * closes the write end, else the EOF would not come. cron_sleep()
+ * wakes up for it on the minute, see svcron.c.
+ */
+static int      barrier[2] = { -1, -1 };
+
+/*- return -1 if the barrier cannot be made */
+int
+barrier_open(void)
+{
+	if (barrier[1] != -1)
+		return (0);
+	if (pipe(barrier) == -1) {
+		strerr_warn2(WARN, "unable to create barrier pipe: ", &strerr_sys);
+		return (-1);
+	}
+	fcntl(barrier[0], F_SETFD, FD_CLOEXEC);
+	fcntl(barrier[1], F_SETFD, FD_CLOEXEC);
+	return (0);
+}
+
+/*- tell if jobs started ahead wait on the barrier */
+int
+barrier_held(void)
+{
+	return (barrier[1] != -1);
+}
 
 void
-do_command(entry *e, const user *u)
+barrier_release(void)
+{
+	if (barrier[1] == -1)
+		return;
+	close(barrier[1]);
+	close(barrier[0]);
+	barrier[0] = barrier[1] = -1;
+}
+
+/*-
+ * sealed memfds holding the % input of commands. one is made by svcron
+ * the first time a command with that input runs, and is shared by all
+ * entries with the same input. every run opens it afresh through
+ * /proc/self/fd, which gives the command a file offset of its own, so
+ * that no process has to sit writing the input into a pipe. at most
+ * INPUT_CACHE memfds are kept open, the one used longest ago is closed
+ * to make room for a new one.
+ */
+#define INPUT_CACHE 32
+static struct input_cache {
+	char           *input;
+	int             fd;
+	unsigned long   used;
+}               incache[INPUT_CACHE];
+static unsigned long inused;
+static int      noproc = -1;	/*- no /proc/self/fd to reopen memfds */
+
+/*-
+ * put input into a sealed memfd. returns -1 where memfds are not
+ * available, the input is then written through a pipe as before.
+ */
+static int
+input_memfd(const char *input)
+{
+#if defined(LINUX) && defined(MFD_ALLOW_SEALING)
+	int             fd;
+	size_t          len;
+	ssize_t         n;
+
+	if ((fd = memfd_create("svcron-input", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+		return (-1);
+	for (len = strlen(input); len; input += n, len -= n) {
+		if ((n = write(fd, input, len)) == -1) {
+			if (errno == error_intr) {
+				n = 0;
+				continue;
+			}
+			close(fd);
+			return (-1);
+		}
+	}
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+#else
+	return (-1);
+#endif
+}
+
+/*- the memfd holding input, made if there is none yet. -1 if none */
+static int
+input_fd(const char *input)
+{
+	struct input_cache *c, *lru = incache;
+	int             fd;
+
+	if (noproc == -1)
+		noproc = access("/proc/self/fd", X_OK) == -1;
+	if (noproc)
+		return (-1);
+	for (c = incache; c < incache + INPUT_CACHE; c++) {
+		if (c->input && !strcmp(c->input, input)) {
+			c->used = ++inused;
+			return (c->fd);
+		}
+		if (lru->input && (!c->input || c->used < lru->used))
+			lru = c;
+	}
+	if ((fd = input_memfd(input)) == -1)
+		return (-1);
+	if (lru->input) {
+		close(lru->fd);
+		free(lru->input);
+	}
+	if (!(lru->input = strdup(input))) {
+		close(fd);
+		return (-1);
+	}
+	lru->fd = fd;
+	lru->used = ++inused;
+	return (fd);
+}
+
+/*- open the input memfd infd for reading from the start, -1 if none */
+static int
+input_open(int infd)
 {
+	char            path[sizeof ("/proc/self/fd/") + FMT_ULONG];
+	int             i;
+
+	if (infd == -1)
+		return (-1);
+	i = fmt_str(path, "/proc/self/fd/");
+	i += fmt_ulong(path + i, (unsigned long) infd);
+	path[i] = 0;
+	return (open(path, O_RDONLY));
+}
+
+/*-
+ * run the command of e due at when. with warm set, the command is made
+ * ready to run and held on the barrier until barrier_release().
+ * returns -1 if no child could be made, see job_spawn() in job.c.
+ */
+pid_t
+do_command(entry *e, const user *u, time_t when, int warm)
+{
+	pid_t           pid;
+	int             infd = e->input ? input_fd(e->input) : -1;
+
 	/*
 	 * fork to become asynchronous -- parent process is done immediately,
 	 * and continues to run the normal svcron code, which means return to
@@ -45,20 +206,21 @@ do_command(entry *e, const user *u)
 	 * vfork() is unsuitable, since we have much to do, and the parent
 	 * needs to be able to run off and fork other processes.
 	 */
-	switch (fork())
+	switch ((pid = fork()))
 	{
 	case -1:
-		strerr_die2sys(111, FATAL, "unable to produce a child: ");
+		strerr_warn2(WARN, "unable to produce a child: ", &strerr_sys);
 		break;
 	case 0:
 		/* child process */
-		child_process(e, u);
+		child_process(e, u, when, warm, infd);
 		_exit(OK_EXIT);
 		break;
 	default:
 		/*- parent process */
 		break;
 	}
+	return (pid);
 }
 
 static void
@@ -104,6 +266,8 @@ sigchld_reaper(char *ident, const entry *e)
 			continue;
 		if (pid == -1 && errno == error_child)
 			break;
+		if (!e) /*- a child of svcron */
+			job_done(pid);
 		if (WIFSTOPPED(status) || WIFCONTINUED(status)) {
 			if (!verbose)
 				continue;
@@ -173,20 +337,21 @@ sigchld_reaper(char *ident, const entry *e)
 }
 
 static void
-child_process(entry *e, const user *u)
+child_process(entry *e, const user *u, time_t when, int warm, int infd)
 {
-	int             stdin_pipe[2], stdout_pipe[2], r;
-	char           *input_data, *usernm, *mailto, *x;
+	int             stdin_pipe[2], stdout_pipe[2], r, cgfd = -1;
+	char           *usernm, *mailto;
 	int             children = 0;
+	pid_t           pid;
 	char            strnum[FMT_ULONG];
 	pid_t           mailpid;
 #ifndef LOGIN_CAP
 	uid_t           uid1, uid2;
 #endif
 
-	/*- discover some useful and important environment settings */
+	/*- all of these were worked out when the crontab was loaded */
 	usernm = e->pwd->pw_name;
-	mailto = myenv_get("MAILTO", e->envp);
+	mailto = e->mailto;
 
 	/*
 	 * our parent is watching for our death by catching SIGCHLD. we
@@ -195,52 +360,40 @@ child_process(entry *e, const user *u)
 	 * was inherited from the parent).
 	 */
 	sig_childdefault();
+	if (barrier[1] != -1)
+		close(barrier[1]);
+	if (!warm && barrier[0] != -1)
+		close(barrier[0]);
 
-	/* create some pipes to talk to our future child */
+	/*
+	 * create some pipes to talk to our future child. % input kept in a
+	 * memfd is read by the child directly and needs no pipe.
+	 */
+	if ((stdin_pipe[READ_PIPE] = input_open(infd)) != -1)
+		stdin_pipe[WRITE_PIPE] = -1;
+	else
 	if (pipe(stdin_pipe) == -1)
 		strerr_die2sys(111, FATAL, "unable to create pipes for child's input: ");
 	if (pipe(stdout_pipe) == -1)
 		strerr_die2sys(111, FATAL, "unable to create pipes for child's output: ");
 
 	/*
-	 * since we are a forked process, we can modify the command string
-	 * we were passed -- nobody else is going to use it again, right?
-	 *
-	 * if a % is present in the command, previous characters are the
-	 * command, and subsequent characters are the additional input to
-	 * the command. An escaped % will have the escape character stripped
-	 * from it. Subsequent %'s will be transformed into newlines,
-	 * but that happens later.
+	 * put the job in a cgroup of its own when asked to. cgroup_fork()
+	 * creates the grandchild directly inside the cgroup.
 	 */
-	/* local */ 
-	{
-		int             escaped = FALSE;
-		int             ch;
-		char           *p;
-
-		for (input_data = p = e->cmd; (ch = *input_data) != '\0'; input_data++, p++) {
-			if (p != input_data)
-				*p = ch;
-			if (escaped) {
-				if (ch == '%')
-					*--p = ch;
-				escaped = FALSE;
-				continue;
-			}
-			if (ch == '\\') {
-				escaped = TRUE;
-				continue;
-			}
-			if (ch == '%') {
-				*input_data++ = '\0';
-				break;
-			}
-		}
-		*p = '\0';
-	}
+	if (CgroupRoot && !(e->flags & NO_CGROUP))
+		cgfd = cgroup_open(e, usernm, getpid());
 
-	/* fork again, this time so we can exec the user's command. */
-	switch (vfork())
+	/*
+	 * fork again, this time so we can exec the user's command. a job
+	 * started ahead waits on the barrier in the grandchild, which
+	 * would keep us suspended after vfork().
+	 */
+	if (cgfd != -1)
+		pid = cgroup_fork(cgfd);
+	else
+		pid = warm ? fork() : vfork();
+	switch (pid)
 	{
 	case -1:
 		strerr_die2sys(111, FATAL, "unable to get a grandchild: ");
@@ -273,7 +426,8 @@ child_process(entry *e, const user *u)
 		 * which would keep it from sending SIGPIPE in otherwise
 		 * appropriate circumstances.
 		 */
-		close(stdin_pipe[WRITE_PIPE]);
+		if (stdin_pipe[WRITE_PIPE] != -1)
+			close(stdin_pipe[WRITE_PIPE]);
 		close(stdout_pipe[READ_PIPE]);
 
 		/*
@@ -354,23 +508,44 @@ child_process(entry *e, const user *u)
 		}
 
 #endif	/* LOGIN_CAP */
-		if (!(x = myenv_get("HOME", e->envp)))
+		/*
+		 * scheduling settings are applied after giving up root,
+		 * so that the kernel decides what the user may ask for.
+		 */
+		set_sched(e);
+		if (!e->home)
 			strerr_die2x(111, FATAL, "grandchild: HOME not set");
-		if (chdir(x) == -1)
-			strerr_die3sys(111, FATAL, "grandchild: chdir: ", x);
+		if (chdir(e->home) == -1)
+			strerr_die3sys(111, FATAL, "grandchild: chdir: ", e->home);
 
 		/* Exec the command. */
 		{
-			char           *shell = myenv_get("SHELL", e->envp);
+			char           *shell = e->shell;
+			char            c;
+			struct timespec ts = { when, 0 };
 
 			if (!shell)
 				strerr_die2x(111, FATAL, "grandchild: SHELL not set");
+			if (warm) {
+				/*- all set up, wait for the minute */
+				while (read(barrier[0], &c, 1) == -1 && errno == error_intr)
+					;
+				/*- EOF before the time if svcron went away */
+				while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR)
+					;
+			}
+			job_exec_late(when + e->delay);
+			if (e->argv)
+				exec_direct(e);
 			execle(shell, shell, "-c", e->cmd, (char *) 0, e->envp);
 			strerr_die3sys(111, FATAL, "grandchild: execle: ", shell);
 		}
 		break;
 	default:
 		/* parent process */
+		e->ppid = getpid(); /*- not shared with a grandchild made by cgroup_fork() */
+		if (warm)
+			close(barrier[0]);
 		break;
 	}
 
@@ -388,21 +563,17 @@ child_process(entry *e, const user *u)
 
 	/*
 	 * write, to the pipe connected to child's stdin, any input specified
-	 * after a % in the crontab entry. while we copy, convert any
-	 * additional %'s to newlines. when done, if some characters were
-	 * written and the last one wasn't a newline, write a newline.
+	 * after a % in the crontab entry, as translated by prepare_entry(),
+	 * unless the grandchild reads it from the memfd.
 	 *
 	 * Note that if the input data won't fit into one pipe buffer (2K
 	 * or 4K on most BSD systems), and the child doesn't read its stdin,
 	 * we would block here. thus we must fork again.
 	 */
 	r = 0;
-	if (*input_data && (r = fork()) == 0) {
+	if (e->input && stdin_pipe[WRITE_PIPE] != -1 && (r = fork()) == 0) {
 		substdio        ssout;
 		char            ssoutbuf[BUFSIZE_OUT];
-		int             need_newline = FALSE;
-		int             escaped = FALSE;
-		char            ch;
 
 		/*
 		 * close the pipe we don't use, since we inherited it and
@@ -410,30 +581,7 @@ child_process(entry *e, const user *u)
 		 */
 		close(stdout_pipe[READ_PIPE]);
 		substdio_fdbuf(&ssout, (ssize_t (*)(int,  char *, size_t)) write, stdin_pipe[WRITE_PIPE], ssoutbuf, sizeof(ssoutbuf));
-
-		/*
-		 * translation:
-		 * \% -> %
-		 * % -> \n
-		 * \x -> \x for all x != %
-		 */
-		while ((ch = *input_data++) != '\0') {
-			if (escaped) {
-				if (ch != '%')
-					substdio_put(&ssout, "\\", 1);
-			} else
-			if (ch == '%')
-				ch = '\n';
-
-			if (!(escaped = (ch == '\\'))) {
-				substdio_put(&ssout, &ch, 1);
-				need_newline = (ch != '\n');
-			}
-		}
-		if (escaped)
-			substdio_put(&ssout, "\\", 1);
-		if (need_newline)
-			substdio_put(&ssout, "\n", 1);
+		substdio_puts(&ssout, e->input);
 
 		/*
 		 * close the pipe, causing an EOF condition.
@@ -450,7 +598,8 @@ child_process(entry *e, const user *u)
 	 * close the pipe to the grandkiddie's stdin, since its wicked uncle
 	 * ernie back there has it open and will close it when he's done.
 	 */
-	close(stdin_pipe[WRITE_PIPE]);
+	if (stdin_pipe[WRITE_PIPE] != -1)
+		close(stdin_pipe[WRITE_PIPE]);
 
 	children++;
 
@@ -473,62 +622,22 @@ child_process(entry *e, const user *u)
 		c = substdio_get(&ssin, &ch, 1);
 		if (c == 1) {
 			FILE           *mail;
+			char            hostname[MAXHOSTNAMELEN + 1];
 			int             bytes = 1;
 			int             status = 0;
 
 			/*
-			 * get name of recipient. this is MAILTO if set to a
-			 * valid local username; USER otherwise.
-			 */
-			if (mailto) { /* MAILTO was present in the environment */
-				if (!*mailto) /* ... but it's empty. set to NULL */
-					mailto = NULL;
-			} else /*- MAILTO not present, set to USER. */
-				mailto = usernm;
-
-			/*- if the resulting mailto isn't safe, don't use it.  */
-			if (mailto != NULL && !safe_p(usernm, mailto))
-				mailto = NULL;
-
-			/*
-			 * if we are supposed to be mailing, MAILTO will
-			 * be non-NULL.  only in this case should we set
-			 * up the mail command and subjects and stuff...
+			 * if we are supposed to be mailing, e->mailto is
+			 * non-NULL and e->mailcmd is the command to run.
 			 */
 			if (mailto != NULL) {
-				char            mailcmd[MAX_COMMAND] = "";
-				const char     *msg = NULL;
-
-				if (Mailer != NULL) {
-					if (strcountstr(Mailer, "%s") == 1) {
-						if (strlens(Mailer, mailto, NULL) - strlen("%s") + sizeof "" > sizeof mailcmd)
-							msg = "Mailer ovf 1";
-						else
-							(void) sprintf(mailcmd, Mailer, mailto);
-					} else
-					if (strlen(Mailer) + sizeof "" > sizeof mailcmd)
-						msg = "Mailer ovf 2";
-					else
-						(void) strcpy(mailcmd, Mailer);
-				} else
-				if (strlens(MAILFMT, MAILARG, NULL) + sizeof "" > sizeof mailcmd)
-					msg = "mailcmd too long";
-				else
-					(void) sprintf(mailcmd, MAILFMT, MAILARG);
-				if (msg != NULL) {
-					if (subprintf(subfderr, "%s %s\n", FATAL, msg) == -1)
-						strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
-					if (substdio_flush(subfderr) == -1)
-						strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
-					_exit(111);
-				}
-				if (!(mail = svcron_popen(mailcmd, "w", e->pwd, &mailpid))) {
-					strerr_warn3(WARN, mailcmd, ": ", &strerr_sys);
+				if (!(mail = svcron_popen(e->mailcmd, "w", e->pwd, &mailpid))) {
+					strerr_warn3(WARN, e->mailcmd, ": ", &strerr_sys);
 					mailto = NULL;
 				}
 				if (verbose) {
 					if (subprintf(subfderr, "%s: mail       pid %10d: user %s command[%s]\n",
-							ProgramName, mailpid, usernm, mailcmd) == -1)
+							ProgramName, mailpid, usernm, e->mailcmd) == -1)
 						strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
 					if (substdio_flush(subfderr) == -1)
 						strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
@@ -540,23 +649,14 @@ child_process(entry *e, const user *u)
 			 * send the headers and first character of body.
 			 */
 			if (mailto != NULL) {
-				char            hostname[MAXHOSTNAMELEN];
-				char          **env;
-
-				gethostname(hostname, MAXHOSTNAMELEN);
-#ifdef MAIL_FROMUSER
-				fprintf(mail, "From: %s\n", usernm);
-#else
-				fprintf(mail, "From: root (svcron Daemon)\n");
-#endif
-				fprintf(mail, "To: %s\n", mailto);
-				fprintf(mail, "Subject: svcron <%s@%s> %s\n", usernm, first_word(hostname, "."), e->cmd);
 #ifdef MAIL_DATE
 				fprintf(mail, "Date: %s\n", arpadate(&StartTime));
 #endif /*MAIL_DATE */
-				for (env = e->envp; *env; env++)
-					fprintf(mail, "X-Cron-Env: <%s>\n", *env);
-				fprintf(mail, "\n");
+				fputs(e->mailhdr, mail);
+				if (gethostname(hostname, sizeof (hostname) - 1) == -1)
+					strcpy(hostname, "localhost");
+				hostname[sizeof (hostname) - 1] = 0;
+				fprintf(mail, "Subject: svcron <%s@%s> %s\n\n", usernm, first_word(hostname, "."), e->cmd);
 
 				/* this was the first char from the pipe */
 				putc(ch, mail);
@@ -610,22 +710,85 @@ child_process(entry *e, const user *u)
 	/* wait for children to die. */
 	for (; children > 0; children--)
 		sigchld_reaper("grandchild", e);
+	if (cgfd != -1)
+		cgroup_close(usernm, cgfd);
 }
 
-static int
-safe_p(const char *usernm, const char *s)
+/*
+ * run e->argv without the shell, searching PATH of the entry when the
+ * program name has no /. this returns only when the program could not
+ * be run. the shell is then left to run the command, so that errors and
+ * scripts without #! are handled the way they always were.
+ */
+static void
+exec_direct(const entry *e)
 {
-	static const char safe_delim[] = "@!:%-.,";	/* conservative! */
-	const char     *t;
-	int             ch, first;
+	char            path[PATH_MAX];
+	const char     *dir, *end;
+	size_t          len, n;
 
-	for (t = s, first = 1; (ch = *t++) != '\0'; first = 0) {
-		if (isascii(ch) && isprint(ch) && (isalnum(ch) || (!first && strchr(safe_delim, ch))))
-			continue;
-		log_it1(usernm, getpid(), "UNSAFE", s, 0);
-		return (FALSE);
+	if (strchr(e->argv[0], '/')) {
+		execve(e->argv[0], e->argv, e->envp);
+		return;
+	}
+	if (!(dir = myenv_get("PATH", e->envp)))
+		return;
+	len = strlen(e->argv[0]);
+	for (;; dir = end + 1) {
+		if (!(end = strchr(dir, ':')))
+			end = dir + strlen(dir);
+		/*- an empty entry in PATH is the current directory */
+		if ((n = end - dir) + len + 2 <= sizeof (path)) {
+			memcpy(path, dir, n);
+			if (n)
+				path[n++] = '/';
+			memcpy(path + n, e->argv[0], len + 1);
+			execve(path, e->argv, e->envp);
+			if (errno == ENOEXEC)
+				return;
+		}
+		if (!*end)
+			return;
 	}
-	return (TRUE);
+}
+
+/*
+ * apply CRON_NICE, CRON_IOCLASS, CRON_SCHED and CRON_CPUS to the
+ * grandchild. This saves running the command under nice(1), ionice(1)
+ * and taskset(1). Failures are reported in the job's output and the
+ * command is run anyway.
+ */
+static void
+set_sched(const entry *e)
+{
+#ifdef LINUX
+	struct sched_param sp = {0};
+	cpu_set_t       set;
+	int             i, policy;
+#endif
+
+	if ((e->flags & SET_NICE) && setpriority(PRIO_PROCESS, 0, e->nice) == -1)
+		strerr_warn2(WARN, "grandchild: unable to set nice value: ", &strerr_sys);
+#ifdef LINUX
+#ifdef SYS_ioprio_set
+	if (e->ioprio && syscall(SYS_ioprio_set, 1 /*- IOPRIO_WHO_PROCESS */, 0, e->ioprio) == -1)
+		strerr_warn2(WARN, "grandchild: unable to set io class: ", &strerr_sys);
+#endif
+	if (e->sched != E_SCHED_NONE) {
+		policy = e->sched == E_SCHED_IDLE ? SCHED_IDLE : (e->sched == E_SCHED_BATCH ? SCHED_BATCH : SCHED_OTHER);
+		if (sched_setscheduler(0, policy, &sp) == -1)
+			strerr_warn2(WARN, "grandchild: unable to set scheduling policy: ", &strerr_sys);
+	}
+	if (e->cpus) {
+		CPU_ZERO(&set);
+		for (i = 0; i < MAX_CPUS && i < CPU_SETSIZE; i++) {
+			if (bit_test(e->cpus, i))
+				CPU_SET(i, &set);
+		}
+		if (sched_setaffinity(0, sizeof (set), &set) == -1)
+			strerr_warn2(WARN, "grandchild: unable to set cpu affinity: ", &strerr_sys);
+	}
+#endif
 }
 
 void
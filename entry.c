@@ -22,6 +22,7 @@
  * vix 30dec86 [written]
  */
 
+#include <limits.h>
 #include <stralloc.h>
 #include "cron.h"
 
@@ -30,12 +31,14 @@ static char     rcsid[] = "$Id: entry.c,v 1.3 2024-09-12 18:48:25+05:30 Cprogram
 #endif
 
 typedef enum ecode {
-	e_none, e_minute, e_hour, e_dom, e_month, e_dow,
-	e_cmd, e_timespec, e_username, e_option, e_memory
+	e_none, e_second, e_minute, e_hour, e_dom, e_month, e_dow,
+	e_cmd, e_timespec, e_username, e_option, e_memory,
+	e_limit, e_sched, e_delay, e_tz, e_every, e_exclude
 } ecode_e;
 
 static const char *ecodes[] = {
 	"no error",
+	"bad second",
 	"bad minute",
 	"bad hour",
 	"bad day-of-month",
@@ -45,21 +48,84 @@ static const char *ecodes[] = {
 	"bad time specifier",
 	"bad username",
 	"bad option",
-	"out of memory"
+	"out of memory",
+	"bad resource limit",
+	"bad scheduling setting",
+	"bad random delay",
+	"bad time zone",
+	"bad interval",
+	"bad EXCLUDE file"
 };
 
+/*-
+ * a~b ranges seen while parsing the current entry. they are resolved
+ * to a single value once the command is known, see spread_entry().
+ */
+#define MAX_JITTER 16
+static struct jitter {
+	bitstr_t       *bits;
+	int             low, first, last;
+} jitter[MAX_JITTER];
+static int      njitter;
+
+/*-
+ * L, W and # terms seen while parsing the day fields of the current
+ * entry. calfield tells get_range() which day field it is parsing.
+ */
+#define CAL_DOM 1
+#define CAL_DOW 2
+static calendar calspec;
+static int      calfield, callast, calused;
+
 static int      get_list(bitstr_t *, int, int, const char *[], int, FILE *);
 static int      get_range(bitstr_t *, int, int, const char *[], int, FILE *);
 static int      get_number(int *, int, const char *[], int, FILE *, const char *);
 static int      set_element(bitstr_t *, int, int, int);
 static int      set_range(bitstr_t *, int, int, int, int, int);
+static int      add_jitter(bitstr_t *, int, int, int, int);
+static int      get_every(const char *, int *, int *);
+static ecode_e  get_env_options(entry *);
+static void     spread_entry(entry *, int);
+static ecode_e  prepare_entry(entry *);
+static int      safe_p(const char *, const char *);
+
+/*-
+ * entry memory comes from the arena of the user when there is one,
+ * from malloc() otherwise, as for svcrontab.
+ */
+static arena   *entry_arena;
 
+static void    *
+entry_alloc(size_t n)
+{
+	return (entry_arena ? arena_alloc(entry_arena, n) : calloc(1, n));
+}
+
+static char    *
+entry_strdup(const char *s)
+{
+	return (entry_arena ? arena_strdup(entry_arena, s) : strdup(s));
+}
+
+/*-
+ * let go of what e shares with other entries. the rest is freed here
+ * only if e is not in an arena, else it goes with the arena.
+ */
 void
 free_entry(entry *e)
 {
+	zone_put(e->tz);
+	calendar_free(e->cal);
+	myenv_release(e->envp);
+	pw_release(e->pwd);
+	if (e->flags & IN_ARENA)
+		return;
 	free(e->cmd);
-	free(e->pwd);
-	myenv_free(e->envp);
+	free(e->input);
+	free(e->argv);
+	free(e->mailcmd);
+	free(e->mailhdr);
+	free(e->cpus);
 	free(e);
 }
 
@@ -74,12 +140,89 @@ myglue_string(stralloc *s, char *s1, char *sep, char *s2)
 	return 0;
 }
 
+/*- set envstr in the array env of *count strings */
+static void
+env_put(char **env, int *count, char *envstr)
+{
+	int             i;
+
+	for (i = 0; i < *count && strcmp_until(env[i], envstr, '='); i++)
+		;
+	env[i] = envstr;
+	if (i == *count)
+		env[++*count] = NULL;
+}
+
+/*-
+ * set the environment of e to envp with SHELL, HOME and PATH added when
+ * missing, and LOGNAME and USER set to the owner of the crontab. the
+ * strings are not copied here, only the interned copy of the result is.
+ */
+static ecode_e
+entry_env(entry *e, struct passwd *pw, char **envp)
+{
+	static stralloc etmp[5] = { { 0 } };
+	static char   **env;
+	static int      size;
+	char          **tenv;
+	int             count;
+
+	for (count = 0; envp[count] != NULL; count++)
+		;
+	if (count + 6 > size) {
+		if (!(tenv = (char **) realloc(env, (count + 6) * sizeof (char *))))
+			return (e_memory);
+		env = tenv;
+		size = count + 6;
+	}
+	memcpy(env, envp, (count + 1) * sizeof (char *));
+	if (!myenv_get("SHELL", env)) {
+		if (myglue_string(&etmp[0], "SHELL", "=", _PATH_BSHELL) == -1) {
+			log_it1("svcron", getpid(), "error", "can't set SHELL", errno);
+			return (e_memory);
+		}
+		env_put(env, &count, etmp[0].s);
+	}
+	if (!myenv_get("HOME", env)) {
+		if (myglue_string(&etmp[1], "HOME", "=", pw->pw_dir) == -1) {
+			log_it1("svcron", getpid(), "error", "can't set HOME", errno);
+			return (e_memory);
+		}
+		env_put(env, &count, etmp[1].s);
+	}
+#ifndef LOGIN_CAP
+	/*- If login.conf is in used we will get the default PATH later. */
+	if (!myenv_get("PATH", env)) {
+		if (myglue_string(&etmp[2], "PATH", "=", _PATH_DEFPATH) == -1) {
+			log_it1("svcron", getpid(), "error", "can't set PATH", errno);
+			return (e_memory);
+		}
+		env_put(env, &count, etmp[2].s);
+	}
+#endif /*- LOGIN_CAP */
+	if (myglue_string(&etmp[3], "LOGNAME", "=", pw->pw_name) == -1) {
+		log_it1("svcron", getpid(), "error", "can't set LOGNAME", errno);
+		return (e_memory);
+	}
+	env_put(env, &count, etmp[3].s);
+#if defined(BSD) || defined(__linux)
+	if (myglue_string(&etmp[4], "USER", "=", pw->pw_name) == -1) {
+		log_it1("svcron", getpid(), "error", "can't set USER", errno);
+		return (e_memory);
+	}
+	env_put(env, &count, etmp[4].s);
+#endif
+	if (!(e->envp = myenv_intern(env)))
+		return (e_memory);
+	return (e_none);
+}
+
 /*-
  * return NULL if eof or syntax error occurs;
  * otherwise return a pointer to a new entry.
  */
 entry          *
-load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char **envp)
+load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char **envp, arena *a)
 {
 	/*-
 	 * this function reads one crontab entry -- the next -- from a file.
@@ -91,17 +234,22 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 	 * syntax:
 	 * user crontab:
 	 *	minutes hours doms months dows cmd\n
+	 * user crontab with CRON_SECONDS=yes:
+	 *	seconds minutes hours doms months dows cmd\n
 	 * system crontab (/etc/indimail/crontab):
 	 *	minutes hours doms months dows USERNAME cmd\n
 	 */
 
 	ecode_e         ecode = e_none;
-	entry          *e;
-	int             ch;
+	entry          *e = NULL;
+	int             ch, spread = 0, sflags;
 	char            cmd[MAX_COMMAND];
-	static stralloc etmp = { 0 };
-	char          **tenvp;
+	char           *x;
 
+	njitter = 0;
+	entry_arena = a;
+	bzero((char *) &calspec, sizeof (calspec));
+	calfield = callast = calused = 0;
 	skip_comments(file);
 
 	ch = get_char(file);
@@ -114,7 +262,12 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 	 * of a list of minutes.
 	 */
 
-	e = (entry *) calloc(sizeof (entry), sizeof (char));
+	if (!(e = (entry *) entry_alloc(sizeof (entry)))) {
+		ecode = e_memory;
+		goto eof;
+	}
+	if (a)
+		e->flags |= IN_ARENA;
 
 	if (ch == '@') {
 		/*-
@@ -129,11 +282,26 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 		 * the schedule, which means we aren't load-limited
 		 * anymore. too much for my overloaded brain. (vix, jan90)
 		 * HINT
+		 *
+		 * With CRON_SPREAD=yes the minute (and for daily and longer
+		 * periods, the hour) is instead picked from a hash of the
+		 * host, user and command. See spread_entry().
 		 */
 		ch = get_string(cmd, MAX_COMMAND, file, " \t\n");
 		if (!strcmp("reboot", cmd))
 			e->flags |= WHEN_REBOOT;
 		else
+		if (!strcmp("every", cmd)) {
+			/*- @every duration[@phase], run on the monotonic clock */
+			Skip_Blanks(ch, file)
+			unget_char(ch, file);
+			ch = get_string(cmd, MAX_COMMAND, file, " \t\n");
+			if (get_every(cmd, &e->every, &e->phase) == -1) {
+				ecode = e_every;
+				goto eof;
+			}
+			e->flags |= EVERY;
+		} else
 		if (!strcmp("yearly", cmd) || !strcmp("annually", cmd)) {
 			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE, FIRST_MINUTE);
 			set_element(e->hour, FIRST_HOUR, LAST_HOUR, FIRST_HOUR);
@@ -141,6 +309,7 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			set_element(e->month, FIRST_MONTH, LAST_MONTH, FIRST_MONTH);
 			set_range(e->dow, FIRST_DOW, LAST_DOW, FIRST_DOW, LAST_DOW, 1);
 			e->flags |= DOW_STAR;
+			spread = 2;
 		} else 
 		if (!strcmp("monthly", cmd)) {
 			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE, FIRST_MINUTE);
@@ -149,6 +318,7 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			set_range(e->month, FIRST_MONTH, LAST_MONTH, FIRST_MONTH, LAST_MONTH, 1);
 			set_range(e->dow, FIRST_DOW, LAST_DOW, FIRST_DOW, LAST_DOW, 1);
 			e->flags |= DOW_STAR;
+			spread = 2;
 		} else 
 		if (!strcmp("weekly", cmd)) {
 			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE, FIRST_MINUTE);
@@ -157,6 +327,7 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			set_range(e->month, FIRST_MONTH, LAST_MONTH, FIRST_MONTH, LAST_MONTH, 1);
 			set_element(e->dow, FIRST_DOW, LAST_DOW, FIRST_DOW);
 			e->flags |= DOW_STAR;
+			spread = 2;
 		} else 
 		if (!strcmp("daily", cmd) || !strcmp("midnight", cmd)) {
 			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE, FIRST_MINUTE);
@@ -164,6 +335,7 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			set_range(e->dom, FIRST_DOM, LAST_DOM, FIRST_DOM, LAST_DOM, 1);
 			set_range(e->month, FIRST_MONTH, LAST_MONTH, FIRST_MONTH, LAST_MONTH, 1);
 			set_range(e->dow, FIRST_DOW, LAST_DOW, FIRST_DOW, LAST_DOW, 1);
+			spread = 2;
 		} else 
 		if (!strcmp("hourly", cmd)) {
 			set_element(e->minute, FIRST_MINUTE, LAST_MINUTE, FIRST_MINUTE);
@@ -172,6 +344,7 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			set_range(e->month, FIRST_MONTH, LAST_MONTH, FIRST_MONTH, LAST_MONTH, 1);
 			set_range(e->dow, FIRST_DOW, LAST_DOW, FIRST_DOW, LAST_DOW, 1);
 			e->flags |= HR_STAR;
+			spread = 1;
 		} else {
 			ecode = e_timespec;
 			goto eof;
@@ -186,6 +359,16 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 			goto eof;
 		}
 	} else {
+		/*- seconds, only when asked for, as the field would break old crontabs */
+		if ((x = myenv_get("CRON_SECONDS", envp)) && !strcmp(x, "yes")) {
+			e->flags |= SECONDS;
+			ch = get_list(e->second, FIRST_SECOND, LAST_SECOND, PPC_NULL, ch, file);
+			if (ch == EOF) {
+				ecode = e_second;
+				goto eof;
+			}
+		}
+
 		if (ch == '*')
 			e->flags |= MIN_STAR;
 		ch = get_list(e->minute, FIRST_MINUTE, LAST_MINUTE, PPC_NULL, ch, file);
@@ -217,7 +400,11 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 		} else {
 			if (ch == '*')
 				e->flags |= DOM_STAR;
+			calfield = CAL_DOM;
 			ch = get_list(e->dom, FIRST_DOM, LAST_DOM, PPC_NULL, ch, file);
+			calfield = 0;
+			if (callast)
+				e->flags |= DOM_LAST;
 		}
 		if (ch == EOF) {
 			ecode = e_dom;
@@ -236,19 +423,15 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 
 		if (ch == '*')
 			e->flags |= DOW_STAR;
+		calfield = CAL_DOW;
 		ch = get_list(e->dow, FIRST_DOW, LAST_DOW, DowNames, ch, file);
+		calfield = 0;
 		if (ch == EOF) {
 			ecode = e_dow;
 			goto eof;
 		}
 	}
 
-	/*- make sundays equivalent */
-	if (bit_test(e->dow, 0) || bit_test(e->dow, 7)) {
-		bit_set(e->dow, 0);
-		bit_set(e->dow, 7);
-	}
-
 	/*- check for permature EOL and catch a common typo */
 	if (ch == '\n' || ch == '*') {
 		ecode = e_cmd;
@@ -282,81 +465,22 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 		}
 	}
 
-	if ((e->pwd = pw_dup(pw)) == NULL) {
+	/*- one copy of the passwd data with pw_passwd zeroed for all entries */
+	if ((e->pwd = pw_share(pw)) == NULL) {
 		ecode = e_memory;
 		goto eof;
 	}
-	bzero(e->pwd->pw_passwd, strlen(e->pwd->pw_passwd));
 
 	/*-
-	 * copy and fix up environment. some variables are just defaults and
-	 * others are overrides.
+	 * fix up environment. some variables are just defaults and others
+	 * are overrides. the entry gets the interned copy of the result.
 	 */
-	if ((e->envp = myenv_copy(envp)) == NULL) {
-		ecode = e_memory;
-		goto eof;
-	}
-	if (!myenv_get("SHELL", e->envp)) {
-		if (myglue_string(&etmp, "SHELL", "=", _PATH_BSHELL) == -1) {
-			log_it1("svcron", getpid(), "error", "can't set SHELL", errno);
-			ecode = e_memory;
-			goto eof;
-		}
-		if ((tenvp = myenv_set(e->envp, etmp.s)) == NULL) {
-			ecode = e_memory;
-			goto eof;
-		}
-		e->envp = tenvp;
-	}
-	if (!myenv_get("HOME", e->envp)) {
-		if (myglue_string(&etmp, "HOME", "=", pw->pw_dir) == -1) {
-			log_it1("svcron", getpid(), "error", "can't set HOME", errno);
-			ecode = e_memory;
-			goto eof;
-		}
-		if ((tenvp = myenv_set(e->envp, etmp.s)) == NULL) {
-			ecode = e_memory;
-			goto eof;
-		}
-		e->envp = tenvp;
-	}
-#ifndef LOGIN_CAP
-	/*- If login.conf is in used we will get the default PATH later. */
-	if (!myenv_get("PATH", e->envp)) {
-		if (myglue_string(&etmp, "PATH", "=", _PATH_DEFPATH) == -1) {
-			log_it1("svcron", getpid(), "error", "can't set PATH", errno);
-			ecode = e_memory;
-			goto eof;
-		}
-		if ((tenvp = myenv_set(e->envp, etmp.s)) == NULL) {
-			ecode = e_memory;
-			goto eof;
-		}
-		e->envp = tenvp;
-	}
-#endif /*- LOGIN_CAP */
-		if (myglue_string(&etmp, "LOGNAME", "=", pw->pw_name) == -1) {
-			log_it1("svcron", getpid(), "error", "can't set LOGNAME", errno);
-			ecode = e_memory;
-			goto eof;
-		}
-	if ((tenvp = myenv_set(e->envp, etmp.s)) == NULL) {
-		ecode = e_memory;
+	if ((ecode = entry_env(e, pw, envp)) != e_none)
 		goto eof;
-	}
-	e->envp = tenvp;
-#if defined(BSD) || defined(__linux)
-		if (myglue_string(&etmp, "USER", "=", pw->pw_name) == -1) {
-			log_it1("svcron", getpid(), "error", "can't set USER", errno);
-			ecode = e_memory;
-			goto eof;
-		}
-	if ((tenvp = myenv_set(e->envp, etmp.s)) == NULL) {
-		ecode = e_memory;
+
+	/*- per entry settings passed through the environment */
+	if ((ecode = get_env_options(e)) != e_none)
 		goto eof;
-	}
-	e->envp = tenvp;
-#endif
 
 	/*- If the first character of the command is '-' it is a svcron option. */
 	while ((ch = get_char(file)) == '-') {
@@ -392,22 +516,73 @@ load_entry(FILE *file, void (*error_func)(const char *), struct passwd *pw, char
 	}
 
 	   /*- got the command in the 'cmd' string; save it in *e. */
-	if ((e->cmd = strdup(cmd)) == NULL) {
+	if ((e->cmd = entry_strdup(cmd)) == NULL) {
 		ecode = e_memory;
 		goto eof;
 	}
 
+	/*- pick values for a~b ranges, @specials, @every phase and RANDOM_DELAY */
+	spread_entry(e, spread);
+
+	/*- make sundays equivalent */
+	if (bit_test(e->dow, 0) || bit_test(e->dow, 7)) {
+		bit_set(e->dow, 0);
+		bit_set(e->dow, 7);
+	}
+
+	/*- L, W, # and EXCLUDE are matched with a map of the days, see calendar.c */
+	if ((calused || calspec.excl) && !(e->flags & (WHEN_REBOOT | EVERY))) {
+		if (!(e->cal = (calendar *) malloc(sizeof (calendar)))) {
+			ecode = e_memory;
+			goto eof;
+		}
+		*e->cal = calspec;
+		calspec.excl = NULL;
+	}
+	/*- an EXCLUDE file not used by an @reboot or @every entry */
+	exclude_put(calspec.excl);
+	calspec.excl = NULL;
+
+	/*- a key for the entry which stays the same across reloads and restarts */
+	e->hash = fnv_hash(FNV_INIT, pw->pw_name, strlen(pw->pw_name) + 1);
+	e->hash = fnv_hash(e->hash, e->cmd, strlen(e->cmd) + 1);
+	if (e->flags & SECONDS)
+		e->hash = fnv_hash(e->hash, e->second, bitstr_size(SECOND_COUNT));
+	e->hash = fnv_hash(e->hash, e->minute, bitstr_size(MINUTE_COUNT));
+	e->hash = fnv_hash(e->hash, e->hour, bitstr_size(HOUR_COUNT));
+	e->hash = fnv_hash(e->hash, e->dom, bitstr_size(DOM_COUNT));
+	e->hash = fnv_hash(e->hash, e->month, bitstr_size(MONTH_COUNT));
+	e->hash = fnv_hash(e->hash, e->dow, bitstr_size(DOW_COUNT));
+	if (e->flags & EVERY) {
+		e->hash = fnv_hash(e->hash, &e->every, sizeof (e->every));
+		e->hash = fnv_hash(e->hash, &e->phase, sizeof (e->phase));
+		e->flags &= ~CATCHUP; /*- intervals do not follow the wall clock */
+	}
+	sflags = e->flags & (DOM_STAR | DOW_STAR | DOM_LAST | WHEN_REBOOT | EVERY);
+	e->hash = fnv_hash(e->hash, &sflags, sizeof (sflags));
+	if (e->tz)
+		e->hash = fnv_hash(e->hash, e->tz->name, strlen(e->tz->name));
+	if (e->cal) {
+		e->hash = fnv_hash(e->hash, e->cal->nearest, bitstr_size(DOM_COUNT));
+		e->hash = fnv_hash(e->hash, &e->cal->lastweekday, sizeof (e->cal->lastweekday));
+		e->hash = fnv_hash(e->hash, &e->cal->lastdow, sizeof (e->cal->lastdow));
+		e->hash = fnv_hash(e->hash, e->cal->nthdow, sizeof (e->cal->nthdow));
+		if (e->cal->excl)
+			e->hash = fnv_hash(e->hash, e->cal->excl->path, strlen(e->cal->excl->path));
+	}
+
+	/*- everything each run of the command needs which does not change */
+	if ((ecode = prepare_entry(e)) != e_none)
+		goto eof;
+
 	   /*- success, fini, return pointer to the entry we just created... */
 	return (e);
 
 eof:
-	if (e->envp)
-		myenv_free(e->envp);
-	if (e->pwd)
-		free(e->pwd);
-	if (e->cmd)
-		free(e->cmd);
-	free(e);
+	exclude_put(calspec.excl);
+	calspec.excl = NULL;
+	if (e)
+		free_entry(e);
 	while (ch != '\n' && !feof(file))
 		ch = get_char(file);
 	if (ecode != e_none && error_func != NULL)
@@ -415,6 +590,530 @@ eof:
 	return (NULL);
 }
 
+/*-
+ * parse an unsigned number in the range [low, high].
+ * return -1 on error
+ */
+static int
+get_uint(const char *str, unsigned int low, unsigned int high, unsigned int *val)
+{
+	char           *end;
+	unsigned long   u;
+
+	if (!isdigit((unsigned char) *str))
+		return (-1);
+	u = strtoul(str, &end, 10);
+	if (*end || u < low || u > high)
+		return (-1);
+	*val = u;
+	return (0);
+}
+
+/*-
+ * parse a size with an optional K, M, G or T suffix. "max" means
+ * no limit and is returned as 0.
+ * return -1 on error
+ */
+static int
+get_size(const char *str, unsigned long *val)
+{
+	char           *end;
+	unsigned long   u;
+
+	if (!strcmp(str, "max")) {
+		*val = 0;
+		return (0);
+	}
+	if (!isdigit((unsigned char) *str))
+		return (-1);
+	u = strtoul(str, &end, 10);
+	switch (*end)
+	{
+	case 'T':
+	case 't':
+		u *= 1024;
+		/*- FALLTHROUGH */
+	case 'G':
+	case 'g':
+		u *= 1024;
+		/*- FALLTHROUGH */
+	case 'M':
+	case 'm':
+		u *= 1024;
+		/*- FALLTHROUGH */
+	case 'K':
+	case 'k':
+		u *= 1024;
+		end++;
+		break;
+	}
+	if (*end || !u)
+		return (-1);
+	*val = u;
+	return (0);
+}
+
+#define MAX_EVERY (366 * SECONDS_PER_DAY)
+
+/*-
+ * parse a duration like 90s, 7m, 1h30m or 2d (a number without a unit
+ * is seconds) into seconds. return a pointer past the duration, or
+ * NULL on error.
+ */
+static const char *
+get_duration(const char *str, int *val)
+{
+	char           *end;
+	unsigned long   u, total = 0;
+
+	if (!isdigit((unsigned char) *str))
+		return (NULL);
+	while (isdigit((unsigned char) *str)) {
+		u = strtoul(str, &end, 10);
+		switch (*end)
+		{
+		case 'd':
+			u *= 24;
+			/*- FALLTHROUGH */
+		case 'h':
+			u *= 60;
+			/*- FALLTHROUGH */
+		case 'm':
+			u *= 60;
+			/*- FALLTHROUGH */
+		case 's':
+			end++;
+			break;
+		}
+		if ((total += u) > MAX_EVERY)
+			return (NULL);
+		str = end;
+	}
+	*val = (int) total;
+	return (str);
+}
+
+/*-
+ * parse the argument of @every, a duration with an optional phase,
+ * e.g. 10m@2m30s. a phase not given is returned as -1.
+ * return -1 on error
+ */
+static int
+get_every(const char *str, int *every, int *phase)
+{
+	if (!(str = get_duration(str, every)) || !*every)
+		return (-1);
+	*phase = -1;
+	if (*str == '@' && (!(str = get_duration(str + 1, phase)) || *phase >= *every))
+		return (-1);
+	return (*str ? -1 : 0);
+}
+
+/*-
+ * parse an io scheduling class, given as idle, best-effort[:level]
+ * or realtime[:level] (or 3, 2[:level], 1[:level]), into an ioprio
+ * value as taken by ioprio_set(2).
+ * return -1 on error
+ */
+static int
+get_ioprio(const char *str, int *val)
+{
+	const char     *x;
+	unsigned int    class, level = 4;
+
+	if (!strncmp(str, "idle", 4) || *str == '3') {
+		x = str + (*str == '3' ? 1 : 4);
+		class = 3;
+	} else
+	if (!strncmp(str, "best-effort", 11) || *str == '2') {
+		x = str + (*str == '2' ? 1 : 11);
+		class = 2;
+	} else
+	if (!strncmp(str, "realtime", 8) || *str == '1') {
+		x = str + (*str == '1' ? 1 : 8);
+		class = 1;
+	} else
+		return (-1);
+	if (*x == ':') {
+		if (class == 3 || get_uint(x + 1, 0, 7, &level) == -1)
+			return (-1);
+	} else
+	if (*x)
+		return (-1);
+	*val = class << 13 | (class == 3 ? 0 : level);
+	return (0);
+}
+
+/*-
+ * parse a cpu list like 0-3,8,10-11 into a bit string.
+ * return -1 on error
+ */
+static int
+get_cpus(const char *str, bitstr_t **cpus)
+{
+	char           *end;
+	unsigned long   first, last;
+
+	if (!(*cpus = (bitstr_t *) entry_alloc(bitstr_size(MAX_CPUS))))
+		return (-1);
+	for (;;) {
+		if (!isdigit((unsigned char) *str))
+			return (-1);
+		first = last = strtoul(str, &end, 10);
+		if (*end == '-') {
+			if (!isdigit((unsigned char) end[1]))
+				return (-1);
+			last = strtoul(end + 1, &end, 10);
+		}
+		if (first > last || last >= MAX_CPUS)
+			return (-1);
+		bit_nset(*cpus, (int) first, (int) last);
+		if (!*end)
+			return (0);
+		if (*end != ',')
+			return (-1);
+		str = end + 1;
+	}
+}
+
+/*-
+ * pick up settings from CRON_ variables in the crontab environment,
+ * so that the launcher does not have to look them up for every run.
+ */
+static ecode_e
+get_env_options(entry *e)
+{
+	char           *x;
+
+	if ((x = myenv_get("CRON_CGROUP", e->envp)) && (!strcmp(x, "no") || !strcmp(x, "none")))
+		e->flags |= NO_CGROUP;
+	if ((x = myenv_get("CRON_MEMORY_MAX", e->envp)) && get_size(x, &e->mem_max) == -1)
+		return (e_limit);
+	if ((x = myenv_get("CRON_CPU_WEIGHT", e->envp)) && get_uint(x, 1, 10000, &e->cpu_weight) == -1)
+		return (e_limit);
+	if ((x = myenv_get("CRON_IO_WEIGHT", e->envp)) && get_uint(x, 1, 10000, &e->io_weight) == -1)
+		return (e_limit);
+	if ((x = myenv_get("CRON_PIDS_MAX", e->envp)) && get_uint(x, 1, UINT_MAX, &e->pids_max) == -1)
+		return (e_limit);
+	if ((x = myenv_get("CRON_NICE", e->envp))) {
+		char           *end;
+
+		e->nice = strtol(x, &end, 10);
+		if (end == x || *end || e->nice < -20 || e->nice > 19)
+			return (e_sched);
+		e->flags |= SET_NICE;
+	}
+	if ((x = myenv_get("CRON_IOCLASS", e->envp)) && get_ioprio(x, &e->ioprio) == -1)
+		return (e_sched);
+	if ((x = myenv_get("CRON_SCHED", e->envp))) {
+		if (!strcmp(x, "idle"))
+			e->sched = E_SCHED_IDLE;
+		else
+		if (!strcmp(x, "batch"))
+			e->sched = E_SCHED_BATCH;
+		else
+		if (!strcmp(x, "other") || !strcmp(x, "normal"))
+			e->sched = E_SCHED_OTHER;
+		else
+			return (e_sched);
+	}
+	if ((x = myenv_get("CRON_CPUS", e->envp)) && get_cpus(x, &e->cpus) == -1)
+		return (e_sched);
+	if ((x = myenv_get("CRON_PRIORITY", e->envp))) {
+		char           *end;
+
+		e->priority = strtol(x, &end, 10);
+		if (end == x || *end || e->priority < -99 || e->priority > 99)
+			return (e_sched);
+	}
+	if ((x = myenv_get("CRON_TZ", e->envp)) && *x && !(e->tz = zone_get(x)))
+		return (e_tz);
+	if ((x = myenv_get("EXCLUDE", e->envp)) && *x && calendar_exclude(&calspec, x, e->pwd) == -1)
+		return (e_exclude);
+	if ((x = myenv_get("CRON_CATCHUP", e->envp)) && !strcmp(x, "yes"))
+		e->flags |= CATCHUP;
+	if ((x = myenv_get("CRON_SPREAD", e->envp)) && !strcmp(x, "yes"))
+		e->flags |= SPREAD;
+	/*- RANDOM_DELAY is in minutes, spread_entry() turns it into seconds */
+	if ((x = myenv_get("RANDOM_DELAY", e->envp)) && get_uint(x, 0, 24 * 60, &e->delay) == -1)
+		return (e_delay);
+	return (e_none);
+}
+
+/*-
+ * resolve everything that depends on a hash of the host, user and
+ * command. this is done once at load time, so that the jobs of many
+ * hosts sharing the same crontab do not all fire at the same second,
+ * while each job still runs at the same time on every run.
+ */
+static const char *
+myhostname(void)
+{
+	static char     hostname[MAXHOSTNAMELEN + 1];
+
+	if (!*hostname && gethostname(hostname, sizeof (hostname) - 1) == -1)
+		strcpy(hostname, "localhost");
+	return (hostname);
+}
+
+static void
+spread_entry(entry *e, int spread)
+{
+	const char     *hostname = myhostname();
+	uint64_t        h, x;
+	unsigned char   c;
+	int             i;
+
+	h = fnv_hash(FNV_INIT, hostname, strlen(hostname) + 1);
+	h = fnv_hash(h, e->pwd->pw_name, strlen(e->pwd->pw_name) + 1);
+	h = fnv_hash(h, e->cmd, strlen(e->cmd));
+	for (i = 0; i < njitter; i++) {
+		c = i;
+		x = fnv_hash(h, &c, 1);
+		bit_set(jitter[i].bits, jitter[i].first - jitter[i].low + (int) (x % (jitter[i].last - jitter[i].first + 1)));
+	}
+	if (spread && (e->flags & SPREAD)) {
+		bit_nclear(e->minute, 0, LAST_MINUTE - FIRST_MINUTE);
+		bit_set(e->minute, (int) (h % MINUTE_COUNT));
+		if (spread > 1) {
+			bit_nclear(e->hour, 0, LAST_HOUR - FIRST_HOUR);
+			bit_set(e->hour, (int) (h / MINUTE_COUNT % HOUR_COUNT));
+		}
+	}
+	if (e->delay)
+		e->delay = fnv_hash(h, "RANDOM_DELAY", 12) % (e->delay * SECONDS_PER_MINUTE);
+	if ((e->flags & EVERY) && e->phase == -1)
+		e->phase = (e->flags & SPREAD) ? (int) (h % (uint64_t) e->every) : 0;
+}
+
+/*-
+ * shell reserved words and builtins. a command starting with one of
+ * these is always run by the shell, even when an external program of
+ * the same name exists, as the two may not behave alike.
+ */
+static const char *builtins[] = {
+	".", ":", "[", "alias", "bg", "break", "builtin", "case", "cd", "command",
+	"continue", "declare", "do", "done", "echo", "elif", "else", "enable", "esac",
+	"eval", "exec", "exit", "export", "false", "fc", "fg", "fi", "for", "function",
+	"getopts", "hash", "if", "in", "jobs", "kill", "let", "local", "logout", "popd",
+	"printf", "pushd", "pwd", "read", "readonly", "return", "select", "set", "shift",
+	"shopt", "source", "test", "then", "time", "times", "trap", "true", "type",
+	"typeset", "ulimit", "umask", "unalias", "unset", "until", "wait", "while",
+	NULL
+};
+
+/*-
+ * split the command of e into e->argv when all the shell would do with
+ * it is split it at blanks and run the program: no quotes, expansions,
+ * redirections or other metacharacters, no variable assignment and no
+ * builtin in front. only the default shell is skipped this way, a
+ * SHELL of the crontab's own choosing may treat commands differently.
+ * with BASH_ENV or ENV set, or % input, the shell is always used.
+ * e->argv is left NULL for the shell to run the command.
+ */
+static ecode_e
+split_command(entry *e)
+{
+	const char    **b;
+	char           *p, *s, **argv;
+	int             argc, inword, ch;
+
+	if (!e->shell || strcmp(e->shell, _PATH_BSHELL) || e->input ||
+			myenv_get("BASH_ENV", e->envp) || myenv_get("ENV", e->envp))
+		return (e_none);
+	for (p = e->cmd, argc = 0, inword = FALSE; (ch = *p); p++) {
+		if (Is_Blank(ch)) {
+			inword = FALSE;
+			continue;
+		}
+		if (!(ch >= 'a' && ch <= 'z') && !(ch >= 'A' && ch <= 'Z') &&
+				!(ch >= '0' && ch <= '9') && !strchr("/._-+,:@%=", ch))
+			return (e_none);
+		if (!inword)
+			argc++;
+		inword = TRUE;
+	}
+	if (!argc)
+		return (e_none);
+	/*- the pointers and a copy of the words in one block */
+	if (!(argv = (char **) entry_alloc((argc + 1) * sizeof (char *) + (p - e->cmd) + 1)))
+		return (e_memory);
+	s = strcpy((char *) (argv + argc + 1), e->cmd);
+	for (argc = 0; *s;) {
+		while (Is_Blank(*s))
+			*s++ = '\0';
+		if (!*s)
+			break;
+		argv[argc++] = s;
+		while (*s && !Is_Blank(*s))
+			s++;
+	}
+	argv[argc] = NULL;
+	if (strchr(argv[0], '=')) {
+		if (!entry_arena)
+			free(argv);
+		return (e_none);
+	}
+	for (b = builtins; *b; b++) {
+		if (!strcmp(argv[0], *b)) {
+			if (!entry_arena)
+				free(argv);
+			return (e_none);
+		}
+	}
+	e->argv = argv;
+	return (e_none);
+}
+
+/*-
+ * work out at load time what child_process() needs for every run of
+ * the command: the command and its input, SHELL and HOME, the command
+ * split into words when it can be run without the shell, the mail
+ * recipient, mailer command and mail headers. this is done after the
+ * entry hash is taken from the full command.
+ */
+static ecode_e
+prepare_entry(entry *e)
+{
+	static stralloc hdr = { 0 };
+	char            mailcmd[MAX_COMMAND] = "";
+	const char     *msg = NULL;
+	char           *input, *p, **env;
+	int             escaped = FALSE, need_newline = FALSE, ch;
+	ecode_e         r;
+
+	/*-
+	 * if a % is present in the command, previous characters are the
+	 * command, and subsequent characters are the additional input to
+	 * the command. An escaped % will have the escape character stripped
+	 * from it. Subsequent %'s will be transformed into newlines.
+	 */
+	for (input = p = e->cmd; (ch = *input) != '\0'; input++, p++) {
+		if (p != input)
+			*p = ch;
+		if (escaped) {
+			if (ch == '%')
+				*--p = ch;
+			escaped = FALSE;
+			continue;
+		}
+		if (ch == '\\') {
+			escaped = TRUE;
+			continue;
+		}
+		if (ch == '%') {
+			*input++ = '\0';
+			break;
+		}
+	}
+	*p = '\0';
+	if (*input) {
+		/*-
+		 * translation:
+		 * \% -> %
+		 * % -> \n
+		 * \x -> \x for all x != %
+		 * and a newline at the end if there is none.
+		 */
+		if (!(e->input = p = entry_alloc(strlen(input) + 3)))
+			return (e_memory);
+		for (escaped = FALSE; (ch = *input++) != '\0';) {
+			if (escaped) {
+				if (ch != '%')
+					*p++ = '\\';
+			} else
+			if (ch == '%')
+				ch = '\n';
+			if (!(escaped = (ch == '\\'))) {
+				*p++ = ch;
+				need_newline = (ch != '\n');
+			}
+		}
+		if (escaped)
+			*p++ = '\\';
+		if (need_newline)
+			*p++ = '\n';
+		*p = '\0';
+	}
+
+	e->shell = myenv_get("SHELL", e->envp);
+	e->home = myenv_get("HOME", e->envp);
+	if ((r = split_command(e)) != e_none)
+		return (r);
+
+	/*-
+	 * mail goes to MAILTO if set to a safe address, none if set empty,
+	 * and to the crontab owner otherwise.
+	 */
+	if ((e->mailto = myenv_get("MAILTO", e->envp))) {
+		if (!*e->mailto)
+			e->mailto = NULL;
+	} else
+		e->mailto = e->pwd->pw_name;
+	if (e->mailto && !safe_p(e->pwd->pw_name, e->mailto))
+		e->mailto = NULL;
+	if (!e->mailto)
+		return (e_none);
+
+	if (Mailer != NULL) {
+		if (strcountstr(Mailer, "%s") == 1) {
+			if (strlens(Mailer, e->mailto, NULL) - strlen("%s") + sizeof "" > sizeof mailcmd)
+				msg = "Mailer ovf 1";
+			else
+				(void) sprintf(mailcmd, Mailer, e->mailto);
+		} else
+		if (strlen(Mailer) + sizeof "" > sizeof mailcmd)
+			msg = "Mailer ovf 2";
+		else
+			(void) strcpy(mailcmd, Mailer);
+	} else
+	if (strlens(MAILFMT, MAILARG, NULL) + sizeof "" > sizeof mailcmd)
+		msg = "mailcmd too long";
+	else
+		(void) sprintf(mailcmd, MAILFMT, MAILARG);
+	if (msg != NULL) {
+		log_it1(e->pwd->pw_name, getpid(), "MAIL", msg, 0);
+		e->mailto = NULL;
+		return (e_none);
+	}
+	if (!(e->mailcmd = entry_strdup(mailcmd)))
+		return (e_memory);
+
+#ifdef MAIL_FROMUSER
+	if (!stralloc_copys(&hdr, "From: ") || !stralloc_cats(&hdr, e->pwd->pw_name) || !stralloc_append(&hdr, "\n"))
+		return (e_memory);
+#else
+	if (!stralloc_copys(&hdr, "From: root (svcron Daemon)\n"))
+		return (e_memory);
+#endif
+	if (!stralloc_cats(&hdr, "To: ") || !stralloc_cats(&hdr, e->mailto) || !stralloc_append(&hdr, "\n"))
+		return (e_memory);
+	for (env = e->envp; *env; env++) {
+		if (!stralloc_cats(&hdr, "X-Cron-Env: <") || !stralloc_cats(&hdr, *env) || !stralloc_cats(&hdr, ">\n"))
+			return (e_memory);
+	}
+	/*- the Subject holds the hostname, which may change, see child_process() */
+	if (!stralloc_0(&hdr) || !(e->mailhdr = entry_strdup(hdr.s)))
+		return (e_memory);
+	return (e_none);
+}
+
+static int
+safe_p(const char *usernm, const char *s)
+{
+	static const char safe_delim[] = "@!:%-.,";	/* conservative! */
+	const char     *t;
+	int             ch, first;
+
+	for (t = s, first = 1; (ch = *t++) != '\0'; first = 0) {
+		if (isascii(ch) && isprint(ch) && (isalnum(ch) || (!first && strchr(safe_delim, ch))))
+			continue;
+		log_it1(usernm, getpid(), "UNSAFE", s, 0);
+		return (FALSE);
+	}
+	return (TRUE);
+}
+
 static int
 get_list(bitstr_t *bits, int low, int high, const char *names[], int ch, FILE *file)
 {
@@ -453,10 +1152,30 @@ get_list(bitstr_t *bits, int low, int high, const char *names[], int ch, FILE *f
 static int
 get_range(bitstr_t *bits, int low, int high, const char *names[], int ch, FILE *file)
 {
-	/*- range = number | number "-" number [ "/" number ] */
+	/*-
+	 * range = number | number "-" number [ "/" number ] | [ number "~" number ] "~"
+	 * day of month only: "L" | "LW" | number "W"
+	 * day of week only: number "L" | number "#" number
+	 */
 
 	int             num1, num2, num3;
 
+	if (ch == 'L' && calfield == CAL_DOM) {
+		/*- L is the last day of the month, LW its last weekday */
+		if ((ch = get_char(file)) == 'W') {
+			calspec.lastweekday = calused = 1;
+			ch = get_char(file);
+		} else
+			callast = 1;
+		return (ch);
+	} else
+	if (ch == '~') {
+		/*- '~' alone picks one of first-last */
+		ch = get_char(file);
+		if (ch == EOF || add_jitter(bits, low, high, low, high) == EOF)
+			return (EOF);
+		return (ch);
+	} else
 	if (ch == '*') {
 		/*- '*' means "first-last" but can still be modified by /step */
 		num1 = low;
@@ -465,10 +1184,48 @@ get_range(bitstr_t *bits, int low, int high, const char *names[], int ch, FILE *
 		if (ch == EOF)
 			return (EOF);
 	} else {
-		ch = get_number(&num1, low, names, ch, file, ",- \t\n");
+		ch = get_number(&num1, low, names, ch, file,
+				calfield == CAL_DOM ? ",-~W \t\n" : calfield == CAL_DOW ? ",-~L# \t\n" : ",-~ \t\n");
 		if (ch == EOF)
 			return (EOF);
 
+		if (ch == 'W') {
+			/*- nW is the weekday nearest to day n, in the same month */
+			if (num1 < low || num1 > high)
+				return (EOF);
+			bit_set(calspec.nearest, num1 - low);
+			calused = 1;
+			return (get_char(file));
+		} else
+		if (ch == 'L') {
+			/*- nL is the last day of week n of the month */
+			if (num1 < low || num1 > high)
+				return (EOF);
+			calspec.lastdow |= 1 << (num1 % 7);
+			calused = 1;
+			return (get_char(file));
+		} else
+		if (ch == '#') {
+			/*- n#k is the k-th day of week n of the month */
+			if (num1 < low || num1 > high || (ch = get_char(file)) == EOF)
+				return (EOF);
+			ch = get_number(&num2, 0, PPC_NULL, ch, file, ", \t\n");
+			if (ch == EOF || num2 < 1 || num2 > 5)
+				return (EOF);
+			calspec.nthdow[num2 - 1] |= 1 << (num1 % 7);
+			calused = 1;
+			return (ch);
+		} else
+		if (ch == '~') {
+			/*- a~b picks one of a-b */
+			ch = get_char(file);
+			if (ch == EOF)
+				return (EOF);
+			ch = get_number(&num2, low, names, ch, file, ", \t\n");
+			if (ch == EOF || add_jitter(bits, low, high, num1, num2) == EOF)
+				return (EOF);
+			return (ch);
+		} else
 		if (ch != '-') {
 			/*- not a range, it's a single number. */
 			if (EOF == set_element(bits, low, high, num1)) {
@@ -576,6 +1333,23 @@ bad:
 	return (EOF);
 }
 
+/*-
+ * remember a~b for the bit string bits. the value is picked by
+ * spread_entry() once the command is known.
+ */
+static int
+add_jitter(bitstr_t *bits, int low, int high, int first, int last)
+{
+	if (first < low || last > high || first > last || njitter == MAX_JITTER)
+		return (EOF);
+	jitter[njitter].bits = bits;
+	jitter[njitter].low = low;
+	jitter[njitter].first = first;
+	jitter[njitter].last = last;
+	njitter++;
+	return (OK);
+}
+
 static int
 set_element(bitstr_t *bits, int low, int high, int number)
 {
@@ -23,6 +23,23 @@
 static char     rcsid[] = "$Id: env.c,v 1.1 2024-06-09 01:04:17+05:30 Cprogrammer Exp mbhangui $";
 #endif
 
+/*-
+ * the environment of an entry is interned: entries with the same
+ * environment share one read-only block, found by a hash of its
+ * strings and freed when the last of them lets go of it. the header
+ * sits in front of the NULL terminated array, and the strings follow
+ * the array in the same allocation.
+ */
+typedef struct _envblock {
+	struct _envblock *next;
+	uint64_t        hash;
+	int             refs, count;
+} envblock;
+
+#define ENV_BUCKETS 64
+
+static envblock *envtab[ENV_BUCKETS];
+
 char          **
 myenv_init(void)
 {
@@ -66,6 +83,66 @@ myenv_copy(char **envp)
 	return (p);
 }
 
+/*-
+ * return the interned copy of envp, which is left as it is. the copy
+ * must not be changed and is given back with myenv_release().
+ */
+char          **
+myenv_intern(char **envp)
+{
+	envblock       *b;
+	uint64_t        h;
+	size_t          len, n;
+	int             count, i;
+	char          **p, *s;
+
+	for (count = 0, len = 0, h = FNV_INIT; envp[count] != NULL; count++) {
+		n = strlen(envp[count]) + 1;
+		h = fnv_hash(h, envp[count], n);
+		len += n;
+	}
+	for (b = envtab[h % ENV_BUCKETS]; b; b = b->next) {
+		if (b->hash != h || b->count != count)
+			continue;
+		for (p = (char **) (b + 1), i = 0; i < count && !strcmp(p[i], envp[i]); i++)
+			;
+		if (i == count) {
+			b->refs++;
+			return (p);
+		}
+	}
+	if (!(b = (envblock *) malloc(sizeof (envblock) + (count + 1) * sizeof (char *) + len)))
+		return (NULL);
+	b->hash = h;
+	b->refs = 1;
+	b->count = count;
+	p = (char **) (b + 1);
+	for (s = (char *) (p + count + 1), i = 0; i < count; i++) {
+		p[i] = strcpy(s, envp[i]);
+		s += strlen(s) + 1;
+	}
+	p[count] = NULL;
+	b->next = envtab[h % ENV_BUCKETS];
+	envtab[h % ENV_BUCKETS] = b;
+	return (p);
+}
+
+void
+myenv_release(char **envp)
+{
+	envblock       *b, **bp;
+
+	if (!envp)
+		return;
+	b = (envblock *) envp - 1;
+	if (--b->refs)
+		return;
+	for (bp = &envtab[b->hash % ENV_BUCKETS]; *bp != b; bp = &(*bp)->next)
+		;
+	*bp = b->next;
+	free(b);
+}
+
 char          **
 myenv_set(char **envp, char *envstr)
 {
@@ -30,25 +30,51 @@
 
 void		set_cron_uid(void),
 		set_cron_cwd(const char *),
-		load_database(cron_db *, char *),
 		open_logfile(void),
 		sigpipe_func(void),
-		job_add(entry *, const user *),
-		do_command(entry *, const user *),
+		job_add(entry *, const user *, time_t),
+		job_catchup(entry *, const user *, time_t),
+		job_forget(const user *),
+		job_rebind(const user *, const user *),
+		carry_user(const user *, user *),
+		job_done(pid_t),
+		job_stats(void),
+		job_exec_late(time_t),
+		barrier_release(void),
+		journal_note(uint64_t, time_t),
+		reboot_note(uint64_t),
+		journal_sync(cron_db *, time_t),
+		zone_put(zone *),
+		calendar_build(calendar *, const entry *, int),
+		calendar_free(calendar *),
+		calendar_flush(void),
+		exclude_put(exclude *),
+		arena_free(arena *),
+		sched_build(cron_db *),
+		sched_free(cron_db *),
+		pw_release(struct passwd *),
 		link_user(cron_db *, user *),
 		unlink_user(cron_db *, user *),
 		free_user(user *),
 		myenv_free(char **),
+		myenv_release(char **),
 		unget_char(int, FILE *),
 		free_entry(entry *),
 		skip_comments(FILE *),
 		log_it1(const char *, int, const char *, const char *, int),
 		log_it2(const char *, int, const char *, const char *),
 		log_close(void),
+		cgroup_close(const char *, int),
 		die_nomem(char *);
 void            sigchld_reaper(char *, const entry *);
 
-int		job_runqueue(void),
+int		load_database(cron_db *, char *, int),
+		job_runqueue(void),
+		job_prewarm(void),
+		reboot_open(void),
+		reboot_started(uint64_t),
+		barrier_open(void),
+		barrier_held(void),
 		get_char(FILE *),
 		get_string(char *, int, FILE *, char *),
 		swap_uids(void),
@@ -60,27 +86,51 @@ int		job_runqueue(void),
 		allowed(const char *, const char *, const char *),
 		strdtb(char *),
 		get_lock(char **, const char *, const char *),
-		strcountstr(const char *, const char *);
+		strcountstr(const char *, const char *),
+		cgroup_init(const char *),
+		cgroup_open(const entry *, const char *, pid_t),
+		calendar_exclude(calendar *, const char *, const struct passwd *),
+		journal_open(void);
 
 size_t		strlens(const char *, ...);
 
+uint64_t	fnv_hash(uint64_t, const void *, size_t);
+
 char		*myenv_get(char *, char **),
 		*arpadate(time_t *),
 		*mkprints(unsigned char *, unsigned int),
 		*first_word(char *, char *),
+		*arena_strdup(arena *, const char *),
 		**myenv_init(void),
 		**myenv_copy(char **),
+		**myenv_intern(char **),
 		**myenv_set(char **, char *);
 
 user		*load_user(int, struct passwd *, const char *),
 		*find_user(cron_db *, const char *);
 
 entry		*load_entry(FILE *, void (*)(const char *),
-			    struct passwd *, char **);
+			    struct passwd *, char **, arena *);
 
 FILE		*svcron_popen(char *, char *, struct passwd *, pid_t *);
 
-struct passwd	*pw_dup(const struct passwd *);
+pid_t		cgroup_fork(int),
+		do_command(entry *, const user *, time_t, int);
+
+time_t		journal_last(uint64_t),
+		job_retry_at(void);
+
+int64_t		job_release_at(void);
+
+long		zone_offset(zone *, time_t);
+
+zone		*zone_get(const char *),
+		*zone_next(zone *);
+
+struct passwd	*pw_dup(const struct passwd *),
+		*pw_share(const struct passwd *);
+
+void		*arena_alloc(arena *, size_t);
 
 #ifndef HAVE_TM_GMTOFF
 long		get_gmtoff(time_t *, struct tm *);
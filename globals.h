@@ -70,6 +70,12 @@ XTRN time_t     StartTime INIT(0);
 XTRN char      *Mailer INIT(NULL);
 XTRN int        DoFork INIT(0);
 XTRN int        verbose INIT(0);
+XTRN char      *CgroupRoot INIT(NULL);
+XTRN unsigned int LaunchRate INIT(0);	/* jobs started per second, 0 for no limit */
+XTRN unsigned int LaunchBurst INIT(0);	/* jobs started at once, default LaunchRate */
+XTRN unsigned int CatchupMax INIT(4);	/* catch-up jobs running at once, 0 for no limit */
+XTRN unsigned int PrewarmLead INIT(0);	/* seconds jobs are started ahead of the minute */
+XTRN int RebootAlways INIT(0);		/* run @reboot entries at every start, not once per boot */
 #ifdef LINUX
 XTRN const struct timespec ts_zero 
 #ifdef MAIN_PROGRAM
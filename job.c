@@ -16,61 +16,700 @@
  * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/mman.h>
+#include <subfd.h>
+#include <strerr.h>
+#include <qprintf.h>
 #include "cron.h"
 
 #if !defined(lint) && !defined(LINT)
 static char     rcsid[] = "$Id: job.c,v 1.2 2024-06-23 23:50:14+05:30 Cprogrammer Exp mbhangui $";
 #endif
 
+#define FATAL "svcron: fatal: "
+#define WARN  "svcron: warn: "
+
 typedef struct _job {
 	struct _job    *next;
 	entry          *e;
 	const user     *u;
+	time_t          when;	/*- time the job was due */
+	time_t          at;	/*- time of the next try, retry queue only */
+	int             tries;	/*- failed starts, retry queue only */
+	int64_t         release; /*- ns on the wall clock, held queue only */
+	int             catchup; /*- a catch-up job, held queue only */
+	int             paced;	/*- has been through pace(), held queue only */
 } job;
 
-static job     *jhead = NULL, *jtail = NULL;
+/*-
+ * the queue of jobs due now. the entries themselves are linked, so
+ * queueing a job allocates nothing. an entry is queued at most once:
+ * its jgen is the generation of the queue it was last put on, and the
+ * generation moves on each time the queue is emptied.
+ */
+static entry   *jhead = NULL, *jtail = NULL;
+static unsigned long jgen = 1;
+static int      jmixed;		/*- a job was queued behind one of lower priority */
+
+/*-
+ * jobs missed while svcron was not running, see catchup_jobs() in
+ * svcron.c. at most CatchupMax of them run at the same time, so they
+ * are kept on a queue of their own across calls of job_runqueue().
+ */
+static job     *chead = NULL, *ctail = NULL;
+static pid_t   *cpids;
+static unsigned int crunning, cheld;
+
+/*-
+ * jobs which could not be started because fork() failed, tried again
+ * after 1, 2, 4, ... seconds and kept in order of the next try. a job
+ * is given up when the minute it was due in (after its RANDOM_DELAY)
+ * is over, or when its entry
+ * is queued again before that, so that it neither runs twice nor runs
+ * long after its time.
+ */
+#define RETRY_SHIFT_MAX 5	/*- longest wait is 32 seconds */
+static job     *rhead = NULL;
+static unsigned long spawn_failed, spawn_dropped;
+
+/*-
+ * jobs held back by RANDOM_DELAY or the rate limit, kept in order of
+ * their release.
+ * svcron does not sleep for them, cron_sleep() wakes up at the first
+ * release, see job_release_at().
+ */
+static job     *hhead = NULL;
+
+/*-
+ * @reboot jobs running, by pid. an @reboot entry is recorded as run
+ * once per boot when its job has completed, see job_done(), so that a
+ * job cut short by a crash of svcron is run again when it restarts.
+ */
+static struct rjob {
+	struct rjob    *next;
+	pid_t           pid;
+	uint64_t        hash;
+}              *rbhead = NULL;
+
+/*-
+ * launch lateness histogram. lateness is the time from the minute a
+ * job was due to the exec of its command, in milliseconds. it is taken
+ * by the grandchild just before exec, so the histogram is kept in a
+ * shared page which all children of svcron write to.
+ */
+static const unsigned long late_limit[] = { 10, 100, 1000, 10000, 60000, 0 };
+static const char *late_name[] = { "<10ms", "<100ms", "<1s", "<10s", "<60s", ">=60s" };
+static struct lateness {
+	unsigned long   count[sizeof (late_limit) / sizeof (late_limit[0])];
+	unsigned long   max;
+}              *late;
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*- map the histogram, before the first child is made */
+static void
+late_map(void)
+{
+	static struct lateness local;
+
+	if (late)
+		return;
+	late = (struct lateness *) mmap(NULL, sizeof (struct lateness), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (late == (struct lateness *) MAP_FAILED)
+		late = &local; /*- only svcron itself sees the counts */
+}
 
 void
-job_add(entry *e, const user *u)
+job_add(entry *e, const user *u, time_t when)
 {
-	job            *j;
+	if (e->warm == when) /*- already started ahead by job_prewarm() */
+		return;
+	if (e->jgen == jgen) /*- already on queue */
+		return;
+	e->jgen = jgen;
+	e->jnext = NULL;
+	e->ju = u;
+	e->jwhen = when;
+	if (jhead == NULL)
+		jhead = e;
+	else {
+		if (e->priority > jtail->priority)
+			jmixed = 1;
+		jtail->jnext = e;
+	}
+	jtail = e;
+}
 
-	/*- if already on queue, keep going */
-	for (j = jhead; j != NULL; j = j->next)
-		if (j->e == e && j->u == u)
-			return;
+/*-
+ * sort the list q by priority, highest first. the sort is stable, so
+ * jobs of equal priority stay in order of discovery.
+ */
+static entry   *
+job_sort(entry *q)
+{
+	entry          *a, *b, *fast, *head, **tail;
+
+	if (!q || !q->jnext)
+		return (q);
+	for (a = q, fast = q->jnext; fast && fast->jnext; fast = fast->jnext->jnext)
+		a = a->jnext;
+	b = a->jnext;
+	a->jnext = NULL;
+	a = job_sort(q);
+	b = job_sort(b);
+	for (tail = &head; a && b; tail = &(*tail)->jnext) {
+		if (a->priority >= b->priority) {
+			*tail = a;
+			a = a->jnext;
+		} else {
+			*tail = b;
+			b = b->jnext;
+		}
+	}
+	*tail = a ? a : b;
+	return (head);
+}
+
+/*- take all queued jobs, in order of priority, leaving the queue empty */
+static entry   *
+job_take(void)
+{
+	entry          *q = jhead;
+
+	if (jmixed)
+		q = job_sort(q);
+	jhead = jtail = NULL;
+	jmixed = 0;
+	jgen++;
+	return (q);
+}
 
-	/*- build a job queue element */
-	if ((j = (job *) malloc(sizeof (job))) == NULL)
+static double
+monotime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*- the time on the wall clock in nanoseconds */
+static int64_t
+wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*-
+ * token bucket dispatch pacer. up to LaunchBurst jobs are started at
+ * once, after which jobs are started at LaunchRate per second, so that
+ * a large number of jobs due in the same minute is spread over the
+ * minute instead of being forked all at once. the bucket is kept
+ * across calls, so catching up on missed minutes is paced as well.
+ * returns 0 if a job may start now, else the time on the wall clock in
+ * ns when its turn comes. the bucket goes into debt for it, so that
+ * the jobs after it get later turns, and the job is held until then.
+ */
+static int64_t
+pace(void)
+{
+	static double   tokens, last;
+	static int      filled;
+	double          now, burst;
+
+	burst = LaunchBurst ? LaunchBurst : LaunchRate;
+	now = monotime();
+	if (!filled) {
+		tokens = burst;
+		filled = 1;
+	} else
+	if ((tokens += (now - last) * LaunchRate) > burst)
+		tokens = burst;
+	last = now;
+	if ((tokens -= 1) >= 0)
+		return (0);
+	return (wall_ns() + (int64_t) (-tokens / LaunchRate * 1e9));
+}
+
+static unsigned long
+late_ms(time_t when)
+{
+	struct timeval  tv;
+
+	gettimeofday(&tv, NULL);
+	if (tv.tv_sec < when)
+		return (0);
+	return ((unsigned long) (tv.tv_sec - when) * 1000 + tv.tv_usec / 1000);
+}
+
+/*- called by the grandchild just before exec of a job due at when */
+void
+job_exec_late(time_t when)
+{
+	unsigned long   ms = late_ms(when), m;
+	int             i;
+
+	if (!late)
 		return;
-	j->next = NULL;
+	for (i = 0; late_limit[i] && ms >= late_limit[i]; i++)
+		;
+	__sync_fetch_and_add(&late->count[i], 1);
+	for (m = late->max; ms > m && !__sync_bool_compare_and_swap(&late->max, m, ms); m = late->max)
+		;
+}
+
+/*- log a job about to be started */
+static void
+job_late(const entry *e, time_t when, const char *how)
+{
+	unsigned long   ms;
+
+	if (verbose) {
+		ms = late_ms(when);
+		if (subprintf(subfderr, "%s: %-10s %s %lu.%03lus late: ", ProgramName, how,
+				e->pwd->pw_name, ms / 1000, ms % 1000) == -1 ||
+				substdio_puts(subfderr, e->cmd) == -1 ||
+				substdio_put(subfderr, "\n", 1) == -1 ||
+				substdio_flush(subfderr) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	}
+}
+
+/*- print the launch lateness histogram */
+void
+job_stats(void)
+{
+	int             i;
+
+	late_map();
+	if (subprintf(subfderr, "%s: lateness  ", ProgramName) == -1)
+		strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	for (i = 0; i < sizeof (late->count) / sizeof (late->count[0]); i++) {
+		if (subprintf(subfderr, " %s %lu", late_name[i], late->count[i]) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	}
+	if (subprintf(subfderr, " max %lu.%03lus\n", late->max / 1000, late->max % 1000) == -1 ||
+			subprintf(subfderr, "%s: spawn      failed %lu dropped %lu\n", ProgramName,
+				spawn_failed, spawn_dropped) == -1 ||
+			substdio_flush(subfderr) == -1)
+		strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+}
+
+/*-
+ * count and report a job dropped because no memory could be had to
+ * queue it. svcron goes on, as memory is likely short only for a while,
+ * e.g. when fork() failed for the same reason.
+ */
+static void
+job_nomem(const entry *e)
+{
+	spawn_dropped++;
+	strerr_warn4(WARN, e->pwd->pw_name, ": out of memory, job dropped: ", e->cmd, 0);
+}
+
+/*- put e due at when on the retry queue after its tries-th failed start */
+static void
+retry_add(entry *e, const user *u, time_t when, int tries)
+{
+	job            *j, **jp;
+
+	if (!(j = (job *) malloc(sizeof (job)))) {
+		job_nomem(e);
+		return;
+	}
 	j->e = e;
 	j->u = u;
+	j->when = when;
+	j->tries = tries;
+	j->at = time(NULL) + (1 << (tries < RETRY_SHIFT_MAX ? tries : RETRY_SHIFT_MAX));
+	if (j->at < when) /*- failed while started ahead, see svcron -p */
+		j->at = when;
+	for (jp = &rhead; *jp && (*jp)->at <= j->at; jp = &(*jp)->next)
+		;
+	j->next = *jp;
+	*jp = j;
+}
 
-	/*- add it to the tail */
-	if (jhead == NULL)
-		jhead = j;
-	else
-		jtail->next = j;
-	jtail = j;
+/*- keep the pid of the job of the @reboot entry with hash key */
+static void
+reboot_add(pid_t pid, uint64_t key)
+{
+	struct rjob    *r;
+
+	if (!(r = (struct rjob *) malloc(sizeof (struct rjob)))) {
+		/*- cannot wait for its completion, record it now */
+		reboot_note(key);
+		return;
+	}
+	r->pid = pid;
+	r->hash = key;
+	r->next = rbhead;
+	rbhead = r;
+}
+
+/*-
+ * start e due at when. if fork() fails, the job is put on the retry
+ * queue to be started without the barrier later. returns -1 then.
+ */
+static pid_t
+job_spawn(entry *e, const user *u, time_t when, int warm, int tries)
+{
+	pid_t           pid;
+
+	if ((pid = do_command(e, u, when, warm)) == -1) {
+		spawn_failed++;
+		retry_add(e, u, when, tries);
+	} else {
+		if (e->flags & CATCHUP)
+			journal_note(e->hash, when);
+		if (e->flags & WHEN_REBOOT)
+			reboot_add(pid, e->hash);
+	}
+	return (pid);
+}
+
+/*- try the jobs on the retry queue whose time has come */
+static int
+job_retry(void)
+{
+	job            *j, **jp;
+	time_t          now = time(NULL);
+	int             run = 0;
+
+	for (jp = &rhead; (j = *jp);) {
+		if (now < j->when + j->e->delay + SECONDS_PER_MINUTE && j->e->jgen != jgen && now < j->at) {
+			jp = &j->next;
+			continue;
+		}
+		*jp = j->next;
+		if (now >= j->when + j->e->delay + SECONDS_PER_MINUTE || j->e->jgen == jgen) {
+			spawn_dropped++;
+			strerr_warn4(WARN, j->e->pwd->pw_name, ": unable to start job in time, dropped: ", j->e->cmd, 0);
+		} else {
+			job_late(j->e, j->when, "retry");
+			run += job_spawn(j->e, j->u, j->when, 0, j->tries + 1) != -1;
+		}
+		free(j);
+	}
+	return (run);
+}
+
+/*- time of the next try of a job on the retry queue, 0 if none */
+time_t
+job_retry_at(void)
+{
+	return (rhead ? rhead->at : 0);
+}
+
+/*- make a job for e due at when, to be put on a queue. NULL if no memory */
+static job     *
+job_new(entry *e, const user *u, time_t when)
+{
+	job            *j;
+
+	if (!(j = (job *) malloc(sizeof (job))))
+		return (NULL);
+	j->e = e;
+	j->u = u;
+	j->when = when;
+	j->catchup = j->paced = 0;
+	return (j);
+}
+
+/*- put j on the held queue until release, ns on the wall clock */
+static void
+hold(job *j, int64_t release)
+{
+	job           **jp;
+
+	j->release = release;
+	if (j->catchup)
+		cheld++;
+	for (jp = &hhead; *jp && (*jp)->release <= release; jp = &(*jp)->next)
+		;
+	j->next = *jp;
+	*jp = j;
+}
+
+/*-
+ * start the catch-up job j. if fork() fails, j is left first on the
+ * catch-up queue for the next call and -1 is returned.
+ */
+static int
+catchup_start(job *j)
+{
+	pid_t           pid;
+
+	if (verbose) {
+		if (subprintf(subfderr, "%s: catch-up   %s: ", ProgramName, j->e->pwd->pw_name) == -1 ||
+				substdio_puts(subfderr, j->e->cmd) == -1 ||
+				substdio_put(subfderr, "\n", 1) == -1 ||
+				substdio_flush(subfderr) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	}
+	if ((pid = do_command(j->e, j->u, j->when, 0)) == -1) {
+		spawn_failed++;
+		if (!(j->next = chead))
+			ctail = j;
+		chead = j;
+		return (-1);
+	}
+	journal_note(j->e->hash, j->when);
+	if (CatchupMax) {
+		if (!cpids && !(cpids = (pid_t *) calloc(CatchupMax, sizeof (pid_t))))
+			strerr_warn2(WARN, "out of memory, catch-up job not counted against the limit", 0);
+		else
+			cpids[crunning++] = pid;
+	}
+	free(j);
+	return (0);
+}
+
+/*- start the held jobs whose time has come */
+static int
+job_release(void)
+{
+	job            *j;
+	int64_t         now = wall_ns(), t;
+	int             run = 0;
+
+	while ((j = hhead) && j->release <= now) {
+		hhead = j->next;
+		if (j->catchup)
+			cheld--;
+		/*- a job released after its RANDOM_DELAY still waits for its turn */
+		if (!j->paced && LaunchRate && j->e->priority <= 0 && (t = pace())) {
+			j->paced = 1;
+			hold(j, t);
+			continue;
+		}
+		if (j->catchup) {
+			run += catchup_start(j) != -1;
+			continue;
+		}
+		job_late(j->e, j->when + j->e->delay, j->paced ? "paced" : "delayed");
+		run += job_spawn(j->e, j->u, j->when, 0, 0) != -1;
+		free(j);
+	}
+	return (run);
+}
+
+/*- time of the first release of a held job in ns, 0 if none */
+int64_t
+job_release_at(void)
+{
+	return (hhead ? hhead->release : 0);
 }
 
 int
 job_runqueue(void)
 {
-	job            *j, *jn;
+	job            *j;
+	entry          *e, *en;
+	int64_t         t;
 	int             run = 0;
 
-	for (j = jhead; j; j = jn) {
-		do_command(j->e, j->u);
-		jn = j->next;
-		free(j);
+	late_map();
+	run = job_retry(); /*- before the queue is taken, see job_retry() */
+	run += job_release();
+	for (e = job_take(); e; e = en) {
+		en = e->jnext;
+		if (e->delay) { /*- RANDOM_DELAY */
+			if ((j = job_new(e, e->ju, e->jwhen)))
+				hold(j, (int64_t) (e->jwhen + e->delay) * 1000000000);
+			else
+				job_nomem(e);
+			continue;
+		}
+		/*- high priority jobs are not paced. without memory to hold it, start it now */
+		if (LaunchRate && e->priority <= 0 && (t = pace()) && (j = job_new(e, e->ju, e->jwhen))) {
+			j->paced = 1;
+			hold(j, t);
+			continue;
+		}
+		job_late(e, e->jwhen, "dispatch");
+		run += job_spawn(e, e->ju, e->jwhen, 0, 0) != -1;
+	}
+
+	/*- start catch-up jobs, as many as allowed */
+	while (chead && (!CatchupMax || crunning + cheld < CatchupMax)) {
+		j = chead;
+		if (!(chead = j->next))
+			ctail = NULL;
+		/*- skip if the entry has run on schedule in the meantime */
+		if (journal_last(j->e->hash) >= j->when) {
+			free(j);
+			continue;
+		}
+		j->catchup = 1;
+		j->paced = 0;
+		if (j->e->delay) {
+			hold(j, (int64_t) (j->when + j->e->delay) * 1000000000);
+			continue;
+		}
+		if (LaunchRate && j->e->priority <= 0 && (t = pace())) {
+			j->paced = 1;
+			hold(j, t);
+			continue;
+		}
+		if (catchup_start(j) == -1)
+			break;
 		run++;
 	}
-	jhead = jtail = NULL;
 	return (run);
 }
 
+/*-
+ * start the queued jobs ahead of their time, see svcron -p. each is
+ * set up up to the exec of its command, where it waits on the barrier
+ * released at the minute. jobs which would be held back anyway by
+ * RANDOM_DELAY or the rate limit are left for the minute, when
+ * find_jobs() queues them again. the others are stamped with the time
+ * they were started for, so job_add() does not queue them again.
+ */
+int
+job_prewarm(void)
+{
+	entry          *e, *en;
+	int             run = 0, warm;
+
+	late_map();
+	/*-
+	 * without a barrier the jobs cannot be held back, so none is
+	 * started early. all are left to find_jobs() at the minute.
+	 */
+	warm = !jhead || barrier_open() != -1;
+	for (e = job_take(); e; e = en) {
+		en = e->jnext;
+		if (warm && !e->delay && (!LaunchRate || e->priority > 0)) {
+			job_late(e, e->jwhen, "prewarm");
+			run += job_spawn(e, e->ju, e->jwhen, 1, 0) != -1;
+			e->warm = e->jwhen; /*- also when it is on the retry queue */
+		}
+	}
+	return (run);
+}
+
+/*- queue a job missed while svcron was down, due at when */
+void
+job_catchup(entry *e, const user *u, time_t when)
+{
+	job            *j;
+
+	for (j = chead; j != NULL; j = j->next)
+		if (j->e == e && j->u == u)
+			return;
+	if ((j = (job *) malloc(sizeof (job))) == NULL) {
+		job_nomem(e);
+		return;
+	}
+	j->next = NULL;
+	j->e = e;
+	j->u = u;
+	j->when = when;
+	if (chead == NULL)
+		chead = j;
+	else
+		ctail->next = j;
+	ctail = j;
+}
+
+/*- called when a child of svcron has been reaped */
+void
+job_done(pid_t pid)
+{
+	struct rjob    *r, **rp;
+	unsigned int    i;
+
+	for (rp = &rbhead; (r = *rp); rp = &r->next) {
+		if (r->pid == pid) {
+			reboot_note(r->hash);
+			*rp = r->next;
+			free(r);
+			return;
+		}
+	}
+	for (i = 0; i < crunning; i++) {
+		if (cpids[i] == pid) {
+			cpids[i] = cpids[--crunning];
+			return;
+		}
+	}
+}
+
+static void
+rebind(job *j, const user *u, const user *nu)
+{
+	entry          *e;
+
+	if (j->u != u)
+		return;
+	for (e = nu->crontab; e != NULL && e->hash != j->e->hash; e = e->next)
+		;
+	if (e) {
+		j->e = e;
+		j->u = nu;
+	}
+}
+
+/*-
+ * move the jobs of u waiting on the catch-up, retry and held queues to nu,
+ * a new version of the crontab, when it has the same entry. the others
+ * are dropped by job_forget() when u is freed.
+ */
+void
+job_rebind(const user *u, const user *nu)
+{
+	job            *j;
+
+	for (j = chead; j != NULL; j = j->next)
+		rebind(j, u, nu);
+	for (j = rhead; j != NULL; j = j->next)
+		rebind(j, u, nu);
+	for (j = hhead; j != NULL; j = j->next)
+		rebind(j, u, nu);
+}
+
+/*- drop queued jobs of a user about to be freed */
+void
+job_forget(const user *u)
+{
+	job            *j, **jp;
+
+	for (jp = &rhead; (j = *jp);) {
+		if (j->u == u) {
+			*jp = j->next;
+			free(j);
+		} else
+			jp = &j->next;
+	}
+
+	for (jp = &hhead; (j = *jp);) {
+		if (j->u == u) {
+			*jp = j->next;
+			if (j->catchup)
+				cheld--;
+			free(j);
+		} else
+			jp = &j->next;
+	}
+
+	for (jp = &chead, ctail = NULL; (j = *jp);) {
+		if (j->u == u) {
+			*jp = j->next;
+			free(j);
+		} else {
+			ctail = j;
+			jp = &j->next;
+		}
+	}
+}
+
 void
 getversion_job_c()
 {
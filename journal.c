@@ -0,0 +1,234 @@
+/*
+ * $Id$
+ *
+ * last-run journal for crontab entries with CRON_CATCHUP=yes.
+ *
+ * The journal is the file JOURNAL_FILE in the crontab directory. It
+ * starts with a 16 byte header and is followed by fixed size records
+ * of an entry hash (see load_entry()) and the time the entry was last
+ * due. Records are only ever appended, a single write of one record at
+ * a time, so a crash can at worst leave a partial last record, which
+ * is ignored. The last record for a hash wins. At startup the file is
+ * mapped and read into a hash table. When the file has grown to more
+ * than twice the number of live records, it is rewritten with one
+ * record per entry still present in the crontabs.
+ */
+#include <sys/mman.h>
+#include <strerr.h>
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+#define WARN  "svcron: warn: "
+
+#define JOURNAL_MAGIC "svcronj1"
+#define JOURNAL_SLACK 1024 /*- records appended before compaction is considered */
+
+struct jrec {
+	uint64_t        key;
+	int64_t         when;
+};
+
+static int      jfd = -1;
+static struct jrec *table;	/*- open addressing, key 0 is an empty slot */
+static unsigned long tsize, nkeys, nrecs;
+
+static struct jrec *
+lookup(struct jrec *t, unsigned long size, uint64_t key)
+{
+	unsigned long   i;
+
+	if (!key)
+		key = 1;
+	for (i = key & (size - 1); t[i].key && t[i].key != key; i = (i + 1) & (size - 1))
+		;
+	return (t + i);
+}
+
+static void
+insert(uint64_t key, time_t when)
+{
+	struct jrec    *old, *r;
+	unsigned long   i, osize;
+
+	if (!key)
+		key = 1;
+	if (2 * (nkeys + 1) > tsize) {
+		old = table;
+		osize = tsize;
+		tsize = tsize ? 2 * tsize : 1024;
+		if (!(table = (struct jrec *) calloc(tsize, sizeof (struct jrec))))
+			die_nomem(FATAL);
+		for (i = 0; i < osize; i++)
+			if (old[i].key)
+				*lookup(table, tsize, old[i].key) = old[i];
+		free(old);
+	}
+	if (!(r = lookup(table, tsize, key))->key) {
+		r->key = key;
+		nkeys++;
+	}
+	r->when = when;
+}
+
+/*
+ * open the journal and load it. returns -1 if the journal cannot be
+ * used, in which case catch-up is disabled.
+ */
+int
+journal_open(void)
+{
+	struct stat     st;
+	struct jrec    *r, *m;
+	char            hdr[16];
+	unsigned long   i, n;
+
+	if ((jfd = open(JOURNAL_FILE, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) == -1) {
+		strerr_warn4(WARN, "unable to open ", JOURNAL_FILE, ": ", &strerr_sys);
+		return (-1);
+	}
+	if (fstat(jfd, &st) == -1) {
+		strerr_warn4(WARN, "unable to stat ", JOURNAL_FILE, ": ", &strerr_sys);
+		close(jfd);
+		return (jfd = -1);
+	}
+	m = st.st_size < (off_t) sizeof (hdr) ? MAP_FAILED : (struct jrec *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, jfd, 0);
+	if (m != MAP_FAILED && memcmp((char *) m, JOURNAL_MAGIC, 8)) {
+		munmap((char *) m, st.st_size);
+		m = MAP_FAILED;
+	}
+	if (m == MAP_FAILED) {
+		if (st.st_size)
+			strerr_warn3(WARN, JOURNAL_FILE, ": bad or empty journal, starting a new one", 0);
+		bzero(hdr, sizeof (hdr));
+		memcpy(hdr, JOURNAL_MAGIC, 8);
+		if (ftruncate(jfd, 0) == -1 || write(jfd, hdr, sizeof (hdr)) != sizeof (hdr)) {
+			strerr_warn4(WARN, "unable to write ", JOURNAL_FILE, ": ", &strerr_sys);
+			close(jfd);
+			return (jfd = -1);
+		}
+		return (0);
+	}
+	/*- the header takes the place of the first record */
+	n = st.st_size / sizeof (struct jrec);
+	for (i = 1, r = m + 1; i < n; i++, r++)
+		insert(r->key, (time_t) r->when);
+	nrecs = n - 1;
+	munmap((char *) m, st.st_size);
+	if (st.st_size % sizeof (struct jrec) && ftruncate(jfd, n * sizeof (struct jrec)) == -1)
+		strerr_warn4(WARN, "unable to truncate ", JOURNAL_FILE, ": ", &strerr_sys);
+	return (0);
+}
+
+/*- the time the entry with hash key was last due, 0 if not known */
+time_t
+journal_last(uint64_t key)
+{
+	if (jfd == -1 || !tsize)
+		return (0);
+	return ((time_t) lookup(table, tsize, key)->when);
+}
+
+/*- record that the entry with hash key was due at when */
+void
+journal_note(uint64_t key, time_t when)
+{
+	struct jrec     r;
+
+	if (jfd == -1)
+		return;
+	insert(key, when);
+	r.key = key ? key : 1;
+	r.when = when;
+	if (write(jfd, (char *) &r, sizeof (r)) != sizeof (r))
+		strerr_warn4(WARN, "unable to write ", JOURNAL_FILE, ": ", &strerr_sys);
+	nrecs++;
+}
+
+/*
+ * called after the crontabs have been (re)loaded. entries with
+ * CRON_CATCHUP which are not in the journal yet get a record for now,
+ * so that downtime from now on is caught up on. when the journal has
+ * grown large enough, it is rewritten with only the records of
+ * entries still present.
+ */
+void
+journal_sync(cron_db *db, time_t now)
+{
+	user           *u;
+	entry          *e;
+	struct jrec    *old, *r, hdr;
+	unsigned long   i, osize, live = 0;
+	int             fd;
+
+	if (jfd == -1)
+		return;
+	for (u = db->head; u; u = u->next) {
+		for (e = u->crontab; e; e = e->next) {
+			if (!(e->flags & CATCHUP))
+				continue;
+			live++;
+			if (!journal_last(e->hash))
+				journal_note(e->hash, now);
+		}
+	}
+	if (nrecs <= 2 * live + JOURNAL_SLACK)
+		return;
+
+	/*- compact. rebuild the table with live entries and write it out */
+	old = table;
+	osize = tsize;
+	table = NULL;
+	tsize = nkeys = 0;
+	for (u = db->head; u; u = u->next) {
+		for (e = u->crontab; e; e = e->next) {
+			if ((e->flags & CATCHUP) && (r = lookup(old, osize, e->hash))->key)
+				insert(r->key, (time_t) r->when);
+		}
+	}
+	free(old);
+	if ((fd = open(JOURNAL_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1) {
+		strerr_warn4(WARN, "unable to create ", JOURNAL_FILE ".tmp", ": ", &strerr_sys);
+		return;
+	}
+	bzero((char *) &hdr, sizeof (hdr));
+	memcpy((char *) &hdr, JOURNAL_MAGIC, 8);
+	if (write(fd, (char *) &hdr, sizeof (hdr)) != sizeof (hdr))
+		goto fail;
+	for (i = 0; i < tsize; i++) {
+		if (table[i].key && write(fd, (char *) (table + i), sizeof (struct jrec)) != sizeof (struct jrec))
+			goto fail;
+	}
+	if (fsync(fd) == -1 || close(fd) == -1) {
+		fd = -1;
+		goto fail;
+	}
+	if (rename(JOURNAL_FILE ".tmp", JOURNAL_FILE) == -1) {
+		fd = -1;
+		goto fail;
+	}
+	close(jfd);
+	if ((jfd = open(JOURNAL_FILE, O_RDWR | O_APPEND | O_CLOEXEC)) == -1)
+		strerr_warn4(WARN, "unable to open ", JOURNAL_FILE, ": ", &strerr_sys);
+	nrecs = nkeys;
+	return;
+fail:
+	strerr_warn4(WARN, "unable to write ", JOURNAL_FILE ".tmp", ": ", &strerr_sys);
+	if (fd != -1)
+		close(fd);
+	unlink(JOURNAL_FILE ".tmp");
+}
+
+void
+getversion_journal_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
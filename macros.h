@@ -49,10 +49,12 @@
 #define MAX_ENVSTR  1000 /* max length of envvar=value\0 strings */
 #define MAX_TEMPSTR  100 /* obvious */
 #define MAX_UNAME     33 /* max length of username, should be overkill */
+#define MAX_CPUS    1024 /* highest cpu number + 1 for CRON_CPUS */
 #define ROOT_UID       0 /* don't change this, it really must be root */
 #define ROOT_USER "root" /* ditto */
 
 #define PPC_NULL ((const char **) NULL)
+#define FNV_INIT 0xcbf29ce484222325ULL /* initial value for fnv_hash() */
 
 #ifndef MAXHOSTNAMELEN
 #define MAXHOSTNAMELEN 64
@@ -77,6 +79,11 @@
 #define SECONDS_PER_MINUTE    60
 #define SECONDS_PER_HOUR    3600
 #define SECONDS_PER_DAY    86400
+#define MAX_CATCHUP (3 * MINUTE_COUNT) /* longest time jump caught up on, minutes */
+
+#define FIRST_SECOND           0
+#define LAST_SECOND           59
+#define SECOND_COUNT (LAST_SECOND - FIRST_SECOND + 1)
 
 #define FIRST_MINUTE           0
 #define LAST_MINUTE           59
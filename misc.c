@@ -691,6 +691,23 @@ die_nomem(char *arg)
 	strerr_die2x(111, arg, ": out of memory");
 }
 
+/*
+ * 64 bit FNV-1a hash of len bytes at buf, continuing from h. Start
+ * with h = FNV_INIT. The value is stable across runs and hosts, so it
+ * can be used for spreading jobs and as a key in state files.
+ */
+uint64_t
+fnv_hash(uint64_t h, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	return (h);
+}
+
 /*
  * Return the offset from GMT in seconds (algorithm taken from sendmail).
  *
@@ -716,7 +733,7 @@ get_gmtoff(time_t *clock, struct tm *local)
 		offset -= 24 * 3600;
 	else
 	if (local->tm_year > gmt.tm_year)
-		offset -= 24 * 3600;
+		offset += 24 * 3600;
 	else
 	if (local->tm_yday < gmt.tm_yday)
 		offset -= 24 * 3600;
@@ -28,7 +28,7 @@
 #ifndef CRONDIR
 /*-
  * CRONDIR is where svcron(8) and svcrontab(1) both chdir
- * to; SPOOL_DIR, LOG_FILE are all relative to this directory.
+ * to; SPOOL_DIR, LOG_FILE, JOURNAL_FILE are all relative to this directory.
  */
 #define CRONDIR   "/var/spool/cron"
 #endif
@@ -60,6 +60,18 @@
  */
 #define LOG_FILE ".log"
 
+/*
+ * last-run journal for entries with CRON_CATCHUP, see journal.c.
+ * relative to CRONDIR too.
+ */
+#define JOURNAL_FILE ".journal"
+
+/*
+ * @reboot entries started since boot, see reboot.c. relative to
+ * CRONDIR too.
+ */
+#define REBOOT_FILE ".reboot"
+
 /*
  * where should the daemon stick its PID?
  * PIDDIR must end in '/'.
@@ -97,6 +109,10 @@
 #define _PATH_DEFPATH "/usr/bin:/bin"
 #endif
 
+#ifndef _PATH_ZONEINFO
+#define _PATH_ZONEINFO "/usr/share/zoneinfo"
+#endif
+
 #ifndef _PATH_TMP
 #define _PATH_TMP "/tmp/"
 #endif
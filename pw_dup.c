@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 #if !defined(lint) && !defined(LINT)
 static char rcsid[] = "$Id: pw_dup.c,v 1.1 2024-06-09 01:04:25+05:30 Cprogrammer Exp mbhangui $";
@@ -126,6 +127,102 @@ pw_dup(const struct passwd *pw) {
 }
 #endif /* !OpenBSD || OpenBSD < 200105 */
 
+/*
+ * passwd records shared by the entries of a user. pw_share() returns
+ * a copy of pw with pw_passwd zeroed, which all entries get for as
+ * long as the user's passwd data stays the same. The copy must not be
+ * changed and is given back with pw_release().
+ */
+typedef struct _pwshare {
+	struct _pwshare	*next;
+	int		 refs;
+	struct passwd	 pw;
+} pwshare;
+
+#define PW_BUCKETS 64
+#define PW_LEN(s) ((s) ? strlen(s) + 1 : 0)
+
+static pwshare	*pwtab[PW_BUCKETS];
+
+static int
+str_same(const char *a, const char *b)
+{
+	return (a == b || (a && b && !strcmp(a, b)));
+}
+
+static int
+pw_same(const struct passwd *a, const struct passwd *b)
+{
+	return (a->pw_uid == b->pw_uid && a->pw_gid == b->pw_gid &&
+	    str_same(a->pw_name, b->pw_name) && str_same(a->pw_gecos, b->pw_gecos) &&
+#ifdef LOGIN_CAP
+	    str_same(a->pw_class, b->pw_class) &&
+#endif /* LOGIN_CAP */
+	    str_same(a->pw_dir, b->pw_dir) && str_same(a->pw_shell, b->pw_shell));
+}
+
+static char *
+pw_strcpy(char **cp, const char *s)
+{
+	char		*p = *cp;
+
+	if (!s)
+		return (NULL);
+	*cp += strlen(s) + 1;
+	return (strcpy(p, s));
+}
+
+struct passwd *
+pw_share(const struct passwd *pw) {
+	pwshare		*s, **bucket = &pwtab[pw->pw_uid % PW_BUCKETS];
+	char		*cp;
+	size_t		 total;
+
+	for (s = *bucket; s; s = s->next) {
+		if (pw_same(&s->pw, pw)) {
+			s->refs++;
+			return (&s->pw);
+		}
+	}
+	total = sizeof(pwshare) + PW_LEN(pw->pw_name) + PW_LEN(pw->pw_passwd) +
+#ifdef LOGIN_CAP
+	    PW_LEN(pw->pw_class) +
+#endif /* LOGIN_CAP */
+	    PW_LEN(pw->pw_gecos) + PW_LEN(pw->pw_dir) + PW_LEN(pw->pw_shell);
+	if ((s = malloc(total)) == NULL)
+		return (NULL);
+	(void)memcpy(&s->pw, pw, sizeof(struct passwd));
+	cp = (char *)(s + 1);
+	s->pw.pw_name = pw_strcpy(&cp, pw->pw_name);
+	if ((s->pw.pw_passwd = pw_strcpy(&cp, pw->pw_passwd)) != NULL)
+		(void)memset(s->pw.pw_passwd, 0, strlen(s->pw.pw_passwd));
+#ifdef LOGIN_CAP
+	s->pw.pw_class = pw_strcpy(&cp, pw->pw_class);
+#endif /* LOGIN_CAP */
+	s->pw.pw_gecos = pw_strcpy(&cp, pw->pw_gecos);
+	s->pw.pw_dir = pw_strcpy(&cp, pw->pw_dir);
+	s->pw.pw_shell = pw_strcpy(&cp, pw->pw_shell);
+	s->refs = 1;
+	s->next = *bucket;
+	*bucket = s;
+	return (&s->pw);
+}
+
+void
+pw_release(struct passwd *pw) {
+	pwshare		*s, **sp;
+
+	if (pw == NULL)
+		return;
+	s = (pwshare *)((char *)pw - offsetof(pwshare, pw));
+	if (--s->refs)
+		return;
+	for (sp = &pwtab[pw->pw_uid % PW_BUCKETS]; *sp != s; sp = &(*sp)->next)
+		;
+	*sp = s->next;
+	free(s);
+}
+
 void
 getversion_pw_dup_c()
 {
@@ -0,0 +1,134 @@
+/*
+ * $Id$
+ *
+ * once per boot state of @reboot entries.
+ *
+ * The state is the file REBOOT_FILE in the crontab directory. It starts
+ * with a header holding the boot id of the kernel, followed by the hash
+ * (see load_entry()) of each @reboot entry whose job has completed since
+ * that boot. A restart of svcron, by supervise after a crash or for an
+ * upgrade, does not run entries found in the file again, while one whose
+ * job was still running is run again. When the boot id is not that
+ * of the running kernel, the system has been rebooted and the file is
+ * started afresh. Hashes are appended with a single write each, so a
+ * crash can at worst leave a partial last record, which is ignored.
+ */
+#include <strerr.h>
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+#define WARN  "svcron: warn: "
+
+#define REBOOT_MAGIC "svcronr1"
+#define BOOT_ID "/proc/sys/kernel/random/boot_id"
+
+struct rhdr {
+	char            magic[8];
+	char            boot[40];	/*- boot id, 36 characters */
+};
+
+static int      rfd = -1;
+static uint64_t *started;
+static unsigned long nstarted;
+
+/*- read the boot id of the running kernel into boot. return -1 on error */
+static int
+boot_id(char *boot, int len)
+{
+	int             fd, n;
+
+	if ((fd = open(BOOT_ID, O_RDONLY | O_CLOEXEC)) == -1)
+		return (-1);
+	n = read(fd, boot, len);
+	close(fd);
+	if (n <= 1 || boot[n - 1] != '\n')
+		return (-1);
+	boot[n - 1] = 0;
+	return (0);
+}
+
+/*
+ * open the state file and load the entries started since boot. returns
+ * -1 if there is no boot id or the file cannot be used, in which case
+ * @reboot entries are run at each start of svcron.
+ */
+int
+reboot_open(void)
+{
+	struct stat     st;
+	struct rhdr     hdr, cur;
+	unsigned long   n;
+
+	bzero((char *) &cur, sizeof (cur));
+	memcpy(cur.magic, REBOOT_MAGIC, 8);
+	if (boot_id(cur.boot, sizeof (cur.boot)) == -1)
+		return (-1);
+	if ((rfd = open(REBOOT_FILE, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) == -1) {
+		strerr_warn4(WARN, "unable to open ", REBOOT_FILE, ": ", &strerr_sys);
+		return (-1);
+	}
+	if (fstat(rfd, &st) == -1) {
+		strerr_warn4(WARN, "unable to stat ", REBOOT_FILE, ": ", &strerr_sys);
+		close(rfd);
+		return (rfd = -1);
+	}
+	if (read(rfd, (char *) &hdr, sizeof (hdr)) == sizeof (hdr) && !memcmp((char *) &hdr, (char *) &cur, sizeof (hdr))) {
+		/*- the same boot */
+		n = (st.st_size - sizeof (hdr)) / sizeof (uint64_t);
+		if (n && !(started = (uint64_t *) malloc(n * sizeof (uint64_t))))
+			die_nomem(FATAL);
+		if (read(rfd, (char *) started, n * sizeof (uint64_t)) != (ssize_t) (n * sizeof (uint64_t))) {
+			strerr_warn4(WARN, "unable to read ", REBOOT_FILE, ": ", &strerr_sys);
+			n = 0;
+		}
+		nstarted = n;
+		if ((st.st_size - sizeof (hdr)) % sizeof (uint64_t) &&
+				ftruncate(rfd, sizeof (hdr) + n * sizeof (uint64_t)) == -1)
+			strerr_warn4(WARN, "unable to truncate ", REBOOT_FILE, ": ", &strerr_sys);
+		return (0);
+	}
+	if (ftruncate(rfd, 0) == -1 || write(rfd, (char *) &cur, sizeof (cur)) != sizeof (cur)) {
+		strerr_warn4(WARN, "unable to write ", REBOOT_FILE, ": ", &strerr_sys);
+		close(rfd);
+		return (rfd = -1);
+	}
+	return (0);
+}
+
+/*- tell if the @reboot entry with hash key has been run since boot */
+int
+reboot_started(uint64_t key)
+{
+	unsigned long   i;
+
+	for (i = 0; i < nstarted; i++) {
+		if (started[i] == key)
+			return (1);
+	}
+	return (0);
+}
+
+/*- record that the job of the @reboot entry with hash key has completed */
+void
+reboot_note(uint64_t key)
+{
+	if (rfd == -1)
+		return;
+	if (write(rfd, (char *) &key, sizeof (key)) != sizeof (key))
+		strerr_warn4(WARN, "unable to write ", REBOOT_FILE, ": ", &strerr_sys);
+}
+
+void
+getversion_reboot_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
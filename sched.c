@@ -0,0 +1,178 @@
+/*
+ * $Id$
+ *
+ * the schedule table of the crontab database.
+ *
+ * Every minute find_jobs() looks at the schedule of all entries. An
+ * entry is large and mostly holds what is needed only when the job is
+ * run, and across many crontabs only a few schedules are in use, like
+ * every minute, every five minutes or @daily. So each distinct schedule
+ * is kept once, as a small record in a table find_jobs() reads straight
+ * through, with the list of entries using it. A schedule is tested once
+ * per minute and all its entries are queued when it is due. The table
+ * is grouped by CRON_TZ zone. Entries with a day map of their own (L,
+ * W, # or EXCLUDE) each get a schedule of their own. Only entries
+ * find_jobs() runs are in the table: not @reboot, @every or entries
+ * with a seconds field not using second 0. Those run every second or
+ * so, and are kept on lists of their own, one for entries with a
+ * seconds field and one for @every, so that second_jobs() and
+ * every_jobs() do not have to go through all entries. The table is
+ * built after the database has been loaded and dropped when it changes.
+ */
+#include <stddef.h>
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+
+static bool
+in_table(const entry *e)
+{
+	if (e->flags & (WHEN_REBOOT | EVERY))
+		return (FALSE);
+	/*- other seconds are run by second_jobs() */
+	return (!(e->flags & SECONDS) || bit_test(e->second, 0));
+}
+
+/*- the part of a schedule compared when interning it */
+#define SCHED_KEY offsetof(sched, first)
+
+void
+sched_build(cron_db *db)
+{
+	sched_table    *t;
+	struct sched_zone *sz;
+	sched           key, *s;
+	user           *u;
+	entry          *e;
+	zone           *z;
+	int            *of = NULL, *slot = NULL;
+	int             n, nz, nsched, hsize, i, j, k0, ns, ne;
+	uint64_t        h;
+
+	for (n = ns = ne = 0, u = db->head; u != NULL; u = u->next) {
+		for (e = u->crontab; e != NULL; e = e->next) {
+			n += in_table(e);
+			if ((e->flags & (SECONDS | WHEN_REBOOT)) == SECONDS)
+				ns++;
+			if (e->flags & EVERY)
+				ne++;
+		}
+	}
+	for (nz = 1, z = zone_next(NULL); z; z = zone_next(z))
+		nz++;
+	for (hsize = 16; hsize < 2 * n; hsize <<= 1)
+		;
+	if (!(t = (sched_table *) malloc(sizeof (sched_table))) ||
+			!(t->hot = (sched *) malloc((n ? n : 1) * sizeof (sched))) ||
+			!(t->cold = (struct sched_ref *) malloc((n ? n : 1) * sizeof (struct sched_ref))) ||
+			!(t->zones = (struct sched_zone *) malloc(nz * sizeof (struct sched_zone))) ||
+			!(t->seconds = (struct sched_ref *) malloc((ns ? ns : 1) * sizeof (struct sched_ref))) ||
+			!(t->every = (struct sched_ref *) malloc((ne ? ne : 1) * sizeof (struct sched_ref))) ||
+			!(of = (int *) malloc((n ? n : 1) * sizeof (int))) ||
+			!(slot = (int *) malloc(hsize * sizeof (int))))
+		die_nomem(FATAL);
+	/*- local time first, then each zone */
+	nsched = n = t->nzones = 0;
+	z = NULL;
+	do {
+		sz = t->zones + t->nzones++;
+		sz->z = z;
+		sz->first = nsched;
+		memset(slot, -1, hsize * sizeof (int));
+		for (k0 = n, u = db->head; u != NULL; u = u->next) {
+			for (e = u->crontab; e != NULL; e = e->next) {
+				if (e->tz != z || !in_table(e))
+					continue;
+				memset(&key, 0, sizeof (key));
+				memcpy(key.minute, e->minute, sizeof (key.minute));
+				memcpy(key.hour, e->hour, sizeof (key.hour));
+				memcpy(key.dom, e->dom, sizeof (key.dom));
+				memcpy(key.month, e->month, sizeof (key.month));
+				memcpy(key.dow, e->dow, sizeof (key.dow));
+				key.flags = e->flags & (MIN_STAR | HR_STAR | DOM_STAR | DOW_STAR | DOM_LAST);
+				i = -1;
+				j = 0;
+				if (e->cal)
+					key.flags |= S_CAL;
+				else {
+					h = fnv_hash(FNV_INIT, &key, SCHED_KEY);
+					for (j = h & (hsize - 1); (i = slot[j]) != -1; j = (j + 1) & (hsize - 1)) {
+						if (!memcmp(t->hot + i, &key, SCHED_KEY))
+							break;
+					}
+				}
+				if (i == -1) {
+					i = nsched++;
+					t->hot[i] = key;
+					if (!e->cal)
+						slot[j] = i;
+				}
+				t->hot[i].count++;
+				of[n++] = i;
+			}
+		}
+		sz->count = nsched - sz->first;
+		/*- the entries of each schedule next to each other, in crontab order */
+		for (i = sz->first, j = k0; i < nsched; i++) {
+			t->hot[i].first = j;
+			j += t->hot[i].count;
+			t->hot[i].count = 0;
+		}
+		for (n = k0, u = db->head; u != NULL; u = u->next) {
+			for (e = u->crontab; e != NULL; e = e->next) {
+				if (e->tz != z || !in_table(e))
+					continue;
+				s = t->hot + of[n++];
+				t->cold[s->first + s->count].e = e;
+				t->cold[s->first + s->count].u = u;
+				s->count++;
+			}
+		}
+	} while ((z = zone_next(z)) != NULL);
+	for (t->nseconds = t->nevery = 0, u = db->head; u != NULL; u = u->next) {
+		for (e = u->crontab; e != NULL; e = e->next) {
+			if ((e->flags & (SECONDS | WHEN_REBOOT)) == SECONDS) {
+				t->seconds[t->nseconds].e = e;
+				t->seconds[t->nseconds++].u = u;
+			}
+			if (e->flags & EVERY) {
+				t->every[t->nevery].e = e;
+				t->every[t->nevery++].u = u;
+			}
+		}
+	}
+	free(of);
+	free(slot);
+	db->tab = t;
+}
+
+void
+sched_free(cron_db *db)
+{
+	sched_table    *t = db->tab;
+
+	if (!t)
+		return;
+	free(t->hot);
+	free(t->cold);
+	free(t->zones);
+	free(t->seconds);
+	free(t->every);
+	free(t);
+	db->tab = NULL;
+}
+
+void
+getversion_sched_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */
@@ -22,17 +22,104 @@
 #ifndef _STRUCTS_H
 #define _STRUCTS_H
 #include <sys/types.h>
+
+/*
+ * a time zone named by CRON_TZ, shared by all entries using it.
+ * see zone.c
+ */
+#define ZONE_TRANS 16
+typedef struct _zone {
+	struct _zone   *next;
+	char           *name;
+	int             refs;
+	int             ntrans;		/* transitions in at, off */
+	time_t          at[ZONE_TRANS];	/* offset off[i] starts at at[i] */
+	long            off[ZONE_TRANS];
+	time_t          until;		/* end of the table */
+	int             vtime;		/* virtual time of the zone, minutes */
+	long            gmtoff;		/* offset at vtime */
+} zone;
+
+/*
+ * the L, W and # terms of the day fields of an entry and the dates of
+ * its EXCLUDE file, compiled into a map of the days of one year. the
+ * map is rebuilt when a day of another year is looked at. see calendar.c
+ */
+#define YEARDAY_COUNT 366
+typedef struct _exclude {	/* shared by the entries naming the same file */
+	char           *path;
+	uid_t           uid;		/* read with the rights of this user */
+	int            *dates;		/* yyyymmdd, yyyy is 0 for every year */
+	int             ndates;
+	int             refs;
+} exclude;
+
+typedef struct _calendar {
+	bitstr_t        bit_decl(nearest, DOM_COUNT);	/* nW, weekday nearest to n */
+	int             lastweekday;	/* LW */
+	unsigned char   lastdow;	/* nL, a bit per day of week */
+	unsigned char   nthdow[5];	/* n#k, a bit per day of week for each k */
+	exclude        *excl;		/* EXCLUDE file, NULL if none */
+	int             year;		/* year of days, 0 if not built */
+	bitstr_t        bit_decl(days, YEARDAY_COUNT);
+} calendar;
+
+/*
+ * the memory a user's crontab is allocated from, a list of chunks with
+ * the one in use first. see arena.c
+ */
+typedef struct _arena_chunk {
+	struct _arena_chunk *next;
+	size_t          size, used;
+} arena_chunk;
+
+typedef struct _arena {
+	arena_chunk    *chunk;
+} arena;
+
 typedef struct _entry {
 	struct _entry  *next;
 	struct passwd  *pwd;
 	char          **envp;
-	char           *cmd;
+	char           *cmd;		/* the command, up to an unescaped % */
+	char           *input;		/* stdin of the command, NULL if none */
+	char          **argv;		/* command split for exec without the shell */
+	char           *shell, *home;	/* SHELL, HOME, point into envp */
+	char           *mailto;		/* checked MAILTO, NULL for no mail */
+	char           *mailcmd;	/* mailer command line */
+	char           *mailhdr;	/* mail headers, all but Subject */
 	pid_t           ppid;
+	bitstr_t        bit_decl(second, SECOND_COUNT); /* only with SECONDS */
 	bitstr_t        bit_decl(minute, MINUTE_COUNT);
 	bitstr_t        bit_decl(hour, HOUR_COUNT);
 	bitstr_t        bit_decl(dom, DOM_COUNT);
 	bitstr_t        bit_decl(month, MONTH_COUNT);
 	bitstr_t        bit_decl(dow, DOW_COUNT);
+	unsigned long   mem_max;	/* CRON_MEMORY_MAX, cgroup memory.max */
+	unsigned int    cpu_weight;	/* CRON_CPU_WEIGHT, cgroup cpu.weight */
+	unsigned int    io_weight;	/* CRON_IO_WEIGHT, cgroup io.weight */
+	unsigned int    pids_max;	/* CRON_PIDS_MAX, cgroup pids.max */
+	bitstr_t       *cpus;		/* CRON_CPUS, cpu affinity */
+	int             nice;		/* CRON_NICE */
+	int             ioprio;		/* CRON_IOCLASS, class << 13 | level */
+	int             sched;		/* CRON_SCHED */
+#define	E_SCHED_NONE	0
+#define	E_SCHED_OTHER	1
+#define	E_SCHED_BATCH	2
+#define	E_SCHED_IDLE	3
+	unsigned int    delay;		/* RANDOM_DELAY, seconds */
+	int             priority;	/* CRON_PRIORITY, higher runs first */
+	uint64_t        hash;		/* stable key for the journal */
+	zone           *tz;		/* CRON_TZ, NULL for local time */
+	calendar       *cal;		/* L, W, # and EXCLUDE, NULL if none */
+	int             every;		/* @every interval, seconds */
+	int             phase;		/* @every phase, -1 if not given */
+	int64_t         due;		/* @every next run, CLOCK_MONOTONIC ns */
+	time_t          warm;		/* due time of a run started ahead, svcron -p */
+	struct _entry  *jnext;		/* next on the job queue, see job.c */
+	const struct _user *ju;		/* user of the queued job */
+	time_t          jwhen;		/* time the queued job was due */
+	unsigned long   jgen;		/* queue generation it was last queued in */
 	int             flags;
 #define	MIN_STAR	0x01
 #define	HR_STAR		0x02
@@ -41,6 +128,13 @@ typedef struct _entry {
 #define	DOM_LAST	0x10
 #define	WHEN_REBOOT	0x20
 #define	DONT_LOG	0x40
+#define	NO_CGROUP	0x80
+#define	SET_NICE	0x100
+#define	SPREAD		0x200
+#define	CATCHUP		0x400
+#define	SECONDS		0x800	/* has a seconds field, CRON_SECONDS */
+#define	EVERY		0x1000	/* @every, not tied to the wall clock */
+#define	IN_ARENA	0x2000	/* allocated from the arena of its user */
 } entry;
 
 /*
@@ -60,16 +154,58 @@ typedef struct _user {
 	time_t          mtime;
 #endif
 	entry          *crontab;	/* this person's crontab */
+	arena           mem;		/* holds this structure and the crontab */
+	unsigned int    seen;		/* last reload which found the crontab, see database.c */
 } user;
 
+/*
+ * a distinct schedule of the entries find_jobs() looks at, kept apart
+ * from the entries in an array of 28 byte records, one array per
+ * database. the records are grouped by CRON_TZ zone. the entries with
+ * this schedule, and their users, are cold[first] to cold[first+count-1]
+ * in crontab order. see sched.c
+ */
+typedef struct _sched {
+	bitstr_t        bit_decl(minute, MINUTE_COUNT);
+	bitstr_t        bit_decl(hour, HOUR_COUNT);
+	bitstr_t        bit_decl(dom, DOM_COUNT);
+	bitstr_t        bit_decl(month, MONTH_COUNT);
+	bitstr_t        bit_decl(dow, DOW_COUNT);
+	unsigned short  flags;		/* entry flags, and S_CAL */
+#define	S_CAL		0x8000	/* day map in the entry, day_match() it */
+	int             first, count;
+} sched;
+
+typedef struct _sched_table {
+	sched          *hot;
+	struct sched_ref {
+		entry          *e;
+		user           *u;
+	}              *cold;
+	struct sched_zone {
+		zone           *z;
+		int             first, count;	/* range of the zone in hot */
+	}              *zones;
+	int             nzones;
+	struct sched_ref *seconds;	/* entries with a seconds field */
+	struct sched_ref *every;	/* @every entries */
+	int             nseconds, nevery;
+} sched_table;
+
 typedef struct _cron_db {
 	user           *head, *tail;	/* links */
+	sched_table    *tab;		/* NULL until built by sched_build() */
 #ifdef LINUX
 	struct timespec mtim;		/* last modtime on spooldir */
 #else
 	time_t          mtime;
 #endif
 } cron_db;
+
+/* what load_database() did */
+#define	DB_UNCHANGED	0	/* no crontab has changed */
+#define	DB_LOADING	1	/* a reload is under way */
+#define	DB_RELOADED	2	/* a reload has been put in place */
 /*
  * in the C tradition, we only create
  * variables for the main program, just
@@ -26,6 +26,7 @@
 #include <error.h>
 #include <qprintf.h>
 #include <subfd.h>
+#include <scan.h>
 #include "cron.h"
 
 #if !defined(lint) && !defined(LINT)
@@ -34,25 +35,57 @@ static char     rcsid[] = "$Id: svcron.c,v 1.4 2024-06-23 23:51:04+05:30 Cprogra
 
 enum timejump { negative, small, medium, large };
 
-static volatile sig_atomic_t got_sighup, got_sigchld;
+#ifdef CLOCK_BOOTTIME
+#define HAVE_BOOTTIME
+#else
+#define CLOCK_BOOTTIME CLOCK_MONOTONIC
+#endif
+
+static volatile sig_atomic_t got_sighup, got_sigchld, got_sigusr1;
 static int      timeRunning, virtualTime, clockTime;
 static long     GMToff;
+/*-
+ * seconds on the monotonic clock, which stops while the system is
+ * suspended, and on the boot clock, which does not, at the time
+ * set_time was last called. neither is affected by clock changes.
+ */
+static time_t   clockMono, clockBoot;
+static long     slept, stepped; /*- seconds suspended, clock step at last wakeup */
+/*-
+ * seconds other than 0 used by entries with a seconds field. when there
+ * are none, svcron wakes up once a minute as it always did.
+ */
+static bitstr_t bit_decl(secondMask, SECOND_COUNT);
+static int      secondsUsed;
+static int64_t  everyNext;	/*- earliest @every due, CLOCK_MONOTONIC ns, 0 if none */
+static int      warmSecond = -1; /*- second of the minute to start the next jobs, -p */
+static int      reloading;	/*- a reload of the crontabs is under way */
+#define RELOAD_SLICE 50		/*- ms of reloading between looking at the clock */
 static char    *dbdir = NULL, *pidfile = NULL;
 
 static void     usage(void);
 static void     run_reboot_jobs(cron_db *);
-static void     find_jobs(int, cron_db *, int, int);
+static void     find_jobs(int, int, cron_db *, zone *, long, int, int);
+static void     catchup_jobs(cron_db *, zone *, time_t);
+static void     second_jobs(cron_db *, int, int, int);
+static void     prewarm_jobs(cron_db *, int);
+static int64_t  mono_now(void);
+static void     every_jobs(cron_db *);
+static void     set_timers(cron_db *);
+static void     reload(cron_db *);
+static void     run_zone(cron_db *, zone *, int *, int, long, bool);
 static void     set_time(int);
 static void     cron_sleep(int);
 static void     sigchld_handler(int);
 static void     sighup_handler(int);
+static void     sigusr1_handler(int);
 static void     quit(int);
 static void     parse_args(int c, char *v[]);
 
 static void
 usage(void)
 {
-	strerr_die4x(100, FATAL, "usage: ", ProgramName, "[-n]\n");
+	strerr_die4x(100, FATAL, "usage: ", ProgramName, " [-v] [-R] [-M mailer] [-d crontabs_dir] [-c cgroup_dir] [-l rate] [-b burst] [-a catchup_jobs] [-p lead]\n");
 }
 
 int
@@ -62,6 +95,7 @@ main(int argc, char *argv[])
 	cron_db        database;
 	char            strnum[FMT_ULONG], dirbuf[256];
 	char           *sdir;
+	zone           *z;
 
 	ProgramName = argv[0];
 
@@ -82,6 +116,9 @@ main(int argc, char *argv[])
 	sact.sa_handler = sighup_handler;
 	if (sigaction(SIGHUP, &sact, NULL) == -1)
 		strerr_die2sys(111, FATAL, "sigaction failed for SIGHUP: ");
+	sact.sa_handler = sigusr1_handler;
+	if (sigaction(SIGUSR1, &sact, NULL) == -1)
+		strerr_die2sys(111, FATAL, "sigaction failed for SIGUSR1: ");
 	sact.sa_handler = quit;
 	if (sigaction(SIGINT, &sact, NULL) == -1)
 		strerr_die2sys(111, FATAL, "sigaction failed for SIGINT: ");
@@ -98,6 +135,9 @@ main(int argc, char *argv[])
 	if (chdir(dbdir) == -1)
 		strerr_warn4(WARN, "unable to switch to ", dbdir, ": ", &strerr_sys);
 	while (get_lock(&pidfile, sdir, dbdir));
+	if (CgroupRoot && cgroup_init(CgroupRoot) == -1)
+		CgroupRoot = NULL; /*- run jobs without cgroups */
+	(void) journal_open();
 
 	if (!env_put2("PATH", _PATH_DEFPATH))
 		die_nomem(FATAL);
@@ -105,13 +145,19 @@ main(int argc, char *argv[])
 	strerr_warn6(ProgramName, ": pid ", strnum, " STARTUP ", CRON_VERSION, ": ", 0);
 	database.head = NULL;
 	database.tail = NULL;
+	database.tab = NULL;
 #ifdef LINUX
 	database.mtim = ts_zero;
 #else
 	database.mtime = ts_zero;
 #endif
-	load_database(&database, dbdir);
+	load_database(&database, dbdir, 0);
 	set_time(TRUE);
+	set_timers(&database);
+	catchup_jobs(&database, NULL, StartTime);
+	for (z = zone_next(NULL); z; z = zone_next(z))
+		catchup_jobs(&database, z, StartTime);
+	journal_sync(&database, StartTime);
 	run_reboot_jobs(&database);
 	timeRunning = virtualTime = clockTime;
 
@@ -129,101 +175,62 @@ main(int argc, char *argv[])
 	 * clockTime: is the time when set_time was last called.
 	 */
 	while (TRUE) {
-		int             timeDiff;
-		enum timejump   wakeupKind;
-
-		/* ... wait for the time (in minutes) to change ... */
+		time_t          prevWall = StartTime, prevMono = clockMono, prevBoot = clockBoot;
+		long            prevGMToff = GMToff, off;
+		zone           *z;
+		int             second = 0, s;
+
+		/*-
+		 * ... wait for the time (in minutes) to change, running the
+		 * jobs of entries with seconds and @every on the way, and
+		 * starting the jobs of the next minute PrewarmLead seconds
+		 * before it ...
+		 */
+		warmSecond = PrewarmLead ? SECONDS_PER_MINUTE - PrewarmLead : -1;
 		do {
 			cron_sleep(timeRunning + 1);
 			set_time(FALSE);
+			if (everyNext)
+				every_jobs(&database);
+			if (secondsUsed && clockTime == timeRunning &&
+					(s = (int) ((StartTime + GMToff) % SECONDS_PER_MINUTE)) > second) {
+				second_jobs(&database, timeRunning, second + 1, s);
+				second = s;
+			}
+			if (clockTime == timeRunning) {
+				job_runqueue();
+				if (reloading)
+					reload(&database);
+			}
+			if (warmSecond != -1 && clockTime == timeRunning &&
+					(StartTime + GMToff) % SECONDS_PER_MINUTE >= warmSecond) {
+				prewarm_jobs(&database, timeRunning + 1);
+				warmSecond = -1;
+			}
 		} while (clockTime == timeRunning);
 		timeRunning = clockTime;
-
-		/*
-		 * Calculate how the current time differs from our virtual
-		 * clock. Classify the change into one of 4 cases.
+		barrier_release(); /*- if cron_sleep() has not let the jobs started ahead run */
+
+		/*-
+		 * the clocks tell what happened since we last woke up:
+		 * time spent suspended shows as a difference between the
+		 * boot and monotonic clocks, a step of the wall clock as a
+		 * difference between the wall and boot clocks, and a DST
+		 * change as a change of the offset from UTC.
 		 */
-		timeDiff = timeRunning - virtualTime;
-
-		/* shortcut for the most common case */
-		if (timeDiff == 1) {
-			virtualTime = timeRunning;
-			find_jobs(virtualTime, &database, TRUE, TRUE);
-		} else {
-			if (timeDiff > (3 * MINUTE_COUNT) || timeDiff < -(3 * MINUTE_COUNT))
-				wakeupKind = large;
-			else
-			if (timeDiff > 5)
-				wakeupKind = medium;
-			else
-			if (timeDiff > 0)
-				wakeupKind = small;
-			else
-				wakeupKind = negative;
-
-			switch (wakeupKind)
-			{
-			case small:
-				/*
-				 * case 1: timeDiff is a small positive number
-				 * (wokeup late) run jobs for each virtual
-				 * minute until caught up.
-				 */
-				do {
-					if (job_runqueue())
-						sleep(10);
-					virtualTime++;
-					find_jobs(virtualTime, &database, TRUE, TRUE);
-				} while (virtualTime < timeRunning);
-				break;
-
-			case medium:
-				/*
-				 * case 2: timeDiff is a medium-sized positive
-				 * number, for example because we went to DST
-				 * run wildcard jobs once, then run any
-				 * fixed-time jobs that would otherwise be
-				 * skipped if we use up our minute (possible,
-				 * if there are a lot of jobs to run) go
-				 * around the loop again so that wildcard jobs
-				 * have a chance to run, and we do our
-				 * housekeeping.
-				 *
-				 * run wildcard jobs for current minute
-				 */
-				find_jobs(timeRunning, &database, TRUE, FALSE);
-
-				/*
-				 * run fixed-time jobs for each minute missed 
-				 */
-				do {
-					if (job_runqueue())
-						sleep(10);
-					virtualTime++;
-					find_jobs(virtualTime, &database, FALSE, TRUE);
-					set_time(FALSE);
-				} while (virtualTime < timeRunning && clockTime == timeRunning);
-				break;
-
-			case negative:
-				/*
-				 * case 3: timeDiff is a small or medium-sized
-				 * negative num, eg. because of DST ending.
-				 * Just run the wildcard jobs. The fixed-time
-				 * jobs probably have already run, and should
-				 * not be repeated. Virtual time does not
-				 * change until we are caught up.
-				 */
-				find_jobs(timeRunning, &database, TRUE, FALSE);
-				break;
-			default:
-				/*
-				 * other: time has changed a *lot*,
-				 * jump virtual time, and run everything
-				 */
-				virtualTime = timeRunning;
-				find_jobs(timeRunning, &database, TRUE, TRUE);
+		slept = (clockBoot - prevBoot) - (clockMono - prevMono);
+		stepped = (StartTime - prevWall) - (clockBoot - prevBoot);
+		run_zone(&database, NULL, &virtualTime, timeRunning, GMToff, GMToff != prevGMToff);
+
+		/*- the same for each CRON_TZ zone, in the time of the zone */
+		for (z = zone_next(NULL); z; z = zone_next(z)) {
+			off = zone_offset(z, StartTime);
+			if (!z->vtime) { /*- zone first used since the last minute */
+				z->vtime = (int) ((StartTime + off) / SECONDS_PER_MINUTE) - 1;
+				z->gmtoff = off;
 			}
+			run_zone(&database, z, &z->vtime, (int) ((StartTime + off) / SECONDS_PER_MINUTE), off, off != z->gmtoff);
+			z->gmtoff = off;
 		}
 
 		/*- Jobs to be run (if any) are loaded; clear the queue. */
@@ -237,61 +244,464 @@ main(int argc, char *argv[])
 			got_sigchld = 0;
 			sigchld_reaper("child", NULL);
 		}
-		load_database(&database, dbdir);
+		if (got_sigusr1) {
+			got_sigusr1 = 0;
+			job_stats();
+		}
+		reload(&database);
+	}
+}
+
+/*-
+ * look for changed crontabs and reload them, RELOAD_SLICE ms at a
+ * time. the jobs of the database in use keep being run in between,
+ * see load_database(). once the reload is finished, the timers are set
+ * up for the new database. nothing more is done when no crontab has
+ * changed, which is the case at most ticks.
+ */
+static void
+reload(cron_db *db)
+{
+	int             r;
+
+	reloading = (r = load_database(db, dbdir, RELOAD_SLICE)) == DB_LOADING;
+	if (r != DB_RELOADED)
+		return;
+	set_timers(db);
+	journal_sync(db, StartTime);
+}
+
+/*-
+ * run the jobs of entries in zone z (NULL for local time) for the
+ * minutes after *vtime up to now, both in the time of the zone. off is
+ * the current offset of the zone from UTC and dst tells if it changed
+ * since the last call. the change of time is classified into one of 4
+ * cases, using what the clocks tell in slept and stepped.
+ */
+static void
+run_zone(cron_db *db, zone *z, int *vtime, int now, long off, bool dst)
+{
+	int             timeDiff = now - *vtime;
+	enum timejump   wakeupKind;
+
+	/* shortcut for the most common case */
+	if (timeDiff == 1) {
+		*vtime = now;
+		find_jobs(now, now, db, z, off, TRUE, TRUE);
+		return;
+	}
+	if (timeDiff > MAX_CATCHUP || timeDiff < -MAX_CATCHUP)
+		wakeupKind = large;
+	else
+	if (timeDiff <= 0)
+		wakeupKind = negative;
+	else
+	if (slept >= SECONDS_PER_MINUTE)
+		wakeupKind = large; /*- like downtime */
+	else
+	if (stepped >= SECONDS_PER_MINUTE || dst)
+		wakeupKind = medium;
+#ifndef HAVE_BOOTTIME
+	else
+	if (timeDiff > 5) /*- can't tell a clock step from a late wakeup */
+		wakeupKind = medium;
+#endif
+	else
+		wakeupKind = small;
+	if (verbose) {
+		if (subprintf(subfderr, "%s: time jump  %s %d minutes: suspended %lds clock step %lds dst %s: %s\n",
+				ProgramName, z ? z->name : "local", timeDiff, slept, stepped, dst ? "yes" : "no",
+				wakeupKind == small ? "late wakeup" : wakeupKind == medium ? "time skipped" :
+				wakeupKind == negative ? "time went back" : "jump") == -1 ||
+				substdio_flush(subfderr) == -1)
+			strerr_die2sys(111, FATAL, "unable to write to descriptor 2: ");
+	}
+
+	switch (wakeupKind)
+	{
+	case small:
+		/*
+		 * case 1: timeDiff is a small positive number
+		 * and the clocks have not changed (wokeup late,
+		 * e.g. on a busy system) run jobs due in any of
+		 * the missed virtual minutes, once each.
+		 */
+		find_jobs(*vtime + 1, now, db, z, off, TRUE, TRUE);
+		*vtime = now;
+		break;
+
+	case medium:
+		/*
+		 * case 2: timeDiff is a positive number because
+		 * we went to DST or the clock was stepped
+		 * forward. run wildcard jobs once, for the current
+		 * minute, and fixed-time jobs due in any of
+		 * the minutes skipped, once each.
+		 */
+		find_jobs(now, now, db, z, off, TRUE, FALSE);
+		find_jobs(*vtime + 1, now, db, z, off, FALSE, TRUE);
+		*vtime = now;
+		break;
+
+	case negative:
+		/*
+		 * case 3: timeDiff is a small or medium-sized
+		 * negative num, eg. because of DST ending.
+		 * Just run the wildcard jobs. The fixed-time
+		 * jobs probably have already run, and should
+		 * not be repeated. Virtual time does not
+		 * change until we are caught up.
+		 */
+		find_jobs(now, now, db, z, off, TRUE, FALSE);
+		break;
+	default:
+		/*
+		 * other: time has changed a *lot*, or the
+		 * system was suspended, which is treated like
+		 * downtime. jump virtual time, and run everything.
+		 * jobs with CRON_CATCHUP missed when time
+		 * jumped forward are run once.
+		 */
+		if (timeDiff > 0)
+			catchup_jobs(db, z, StartTime - SECONDS_PER_MINUTE);
+		*vtime = now;
+		find_jobs(now, now, db, z, off, TRUE, TRUE);
 	}
 }
 
+/*-
+ * run the @reboot entries. each is run once per boot of the system,
+ * not again when svcron is restarted, see reboot.c. with svcron -R,
+ * or when the boot id is not known, they are run at every start.
+ */
 static void
 run_reboot_jobs(cron_db *db)
 {
 	user           *u;
 	entry          *e;
 
+	if (!RebootAlways)
+		(void) reboot_open();
 	for (u = db->head; u != NULL; u = u->next) {
 		for (e = u->crontab; e != NULL; e = e->next) {
-			if (e->flags & WHEN_REBOOT)
-				job_add(e, u);
+			if ((e->flags & WHEN_REBOOT) && !reboot_started(e->hash))
+				job_add(e, u, StartTime);
 		}
 	}
 	(void) job_runqueue();
 }
 
+/*
+ * the dom/dow situation is odd. '* * 1,15 * Sun' will run on the
+ * first and fifteenth AND every Sunday; '* * * * Sun' will run *only*
+ * on Sundays; '* * 1,15 * *' will run *only* the 1st and 15th. this
+ * is why we keep 'e->dow_star' and 'e->dom_star'. yes, it's bizarre.
+ * like many bizarre things, it's the standard.
+ *
+ * entries with L, W, # or EXCLUDE have all of this worked out in a map
+ * of the days of the year, see calendar.c
+ */
+static bool
+day_match(const entry *e, int year, int yday, int dom, int dow, bool is_lastdom)
+{
+	bool            thisdom, thisdow;
+
+	if (e->cal) {
+		if (e->cal->year != year)
+			calendar_build(e->cal, e, year);
+		return (bit_test(e->cal->days, yday));
+	}
+	thisdom = bit_test(e->dom, dom) || (is_lastdom && (e->flags & DOM_LAST) != 0);
+	thisdow = bit_test(e->dow, dow);
+
+	return ((e->flags & (DOM_STAR | DOW_STAR)) != 0 ? (thisdom && thisdow) : (thisdom || thisdow));
+}
+
+/*- day_match() for a record of the schedule table */
+static bool
+sched_day_match(const sched_table *t, const sched *s, int year, int yday, int dom, int dow, bool is_lastdom)
+{
+	bool            thisdom, thisdow;
+
+	if (s->flags & S_CAL) /*- the only entry of s */
+		return (day_match(t->cold[s->first].e, year, yday, dom, dow, is_lastdom));
+	thisdom = bit_test(s->dom, dom) || (is_lastdom && (s->flags & DOM_LAST) != 0);
+	thisdow = bit_test(s->dow, dow);
+
+	return ((s->flags & (DOM_STAR | DOW_STAR)) != 0 ? (thisdom && thisdow) : (thisdom || thisdow));
+}
+
+/*-
+ * queue the jobs due in any of the minutes first to last. the minutes
+ * are split into slices of one hour each, for which the hour and day
+ * are fixed, so that every entry is looked at once per hour instead of
+ * once per minute. a job due more than once in the window is queued
+ * only once. the distinct schedules of zone z are read from the
+ * schedule table, and all entries of a schedule due are queued.
+ */
+#define MAX_SLICES (MAX_CATCHUP / MINUTE_COUNT + 2)
+static void
+find_jobs(int first, int last, cron_db *db, zone *z, long off, int doWild, int doNonWild)
+{
+	struct slice {
+		bitstr_t        bit_decl(minute, MINUTE_COUNT);
+		int             m0, hour, dom, month, dow, year, yday;
+		bool            is_lastdom;
+		time_t          start;
+	}               slices[MAX_SLICES], *sl;
+	time_t          virtualSecond, virtualTomorrow;
+	const sched_table *t = db->tab;
+	const struct sched_zone *sz;
+	const sched    *s, *end;
+	struct tm       now = {0}, tom = {0};
+	int             nslices, vtime, i, k;
+
+	for (sz = t->zones; sz < t->zones + t->nzones && sz->z != z; sz++)
+		;
+	if (sz == t->zones + t->nzones || !sz->count)
+		return;
+
+	if (last - first >= MAX_CATCHUP)
+		first = last - MAX_CATCHUP + 1;
+	for (nslices = 0, vtime = first; vtime <= last; nslices++) {
+		sl = slices + nslices;
+		virtualSecond = vtime * SECONDS_PER_MINUTE;
+		virtualTomorrow = virtualSecond + SECONDS_PER_DAY;
+		gmtime_r(&virtualSecond, &now);
+		gmtime_r(&virtualTomorrow, &tom);
+		/*- make 0-based values out of these so we can use them as indicies */
+		sl->m0 = now.tm_min - FIRST_MINUTE;
+		sl->hour = now.tm_hour - FIRST_HOUR;
+		sl->dom = now.tm_mday - FIRST_DOM;
+		sl->month = now.tm_mon + 1 /* 0..11 -> 1..12 */  - FIRST_MONTH;
+		sl->dow = now.tm_wday - FIRST_DOW;
+		sl->year = now.tm_year + 1900;
+		sl->yday = now.tm_yday;
+		sl->is_lastdom = (tom.tm_mday == 1);
+		sl->start = virtualSecond - off;
+		bit_nclear(sl->minute, 0, MINUTE_COUNT - 1);
+		for (i = sl->m0; i < MINUTE_COUNT && vtime <= last; i++, vtime++)
+			bit_set(sl->minute, i);
+	}
+
+	for (s = t->hot + sz->first, end = s + sz->count; s < end; s++) {
+		if (!((doNonWild && (s->flags & (MIN_STAR | HR_STAR)) == 0) || (doWild && (s->flags & (MIN_STAR | HR_STAR)) != 0)))
+			continue;
+		for (sl = slices; sl < slices + nslices; sl++) {
+			if (!bit_test(s->hour, sl->hour) || !bit_test(s->month, sl->month) ||
+					!sched_day_match(t, s, sl->year, sl->yday, sl->dom, sl->dow, sl->is_lastdom))
+				continue;
+			for (k = 0; k < bitstr_size(MINUTE_COUNT); k++)
+				if (s->minute[k] & sl->minute[k])
+					break;
+			if (k == bitstr_size(MINUTE_COUNT))
+				continue;
+			for (i = sl->m0; !bit_test(s->minute, i) || !bit_test(sl->minute, i); i++)
+				;
+			for (k = s->first; k < s->first + s->count; k++)
+				job_add(t->cold[k].e, t->cold[k].u, sl->start + (i - sl->m0) * SECONDS_PER_MINUTE);
+			break;
+		}
+	}
+}
+
+/*-
+ * queue the jobs of entries with a seconds field due in the seconds
+ * first to last of the minute vtime, local time. entries of a CRON_TZ
+ * zone are matched against the same minute in the time of the zone.
+ */
+static void
+second_jobs(cron_db *db, int vtime, int first, int last)
+{
+	const sched_table *t = db->tab;
+	entry          *e;
+	zone           *z = NULL;
+	time_t          tt;
+	long            off = GMToff;
+	struct tm       now = {0}, tom = {0};
+	int             i, s;
+
+	for (i = 0; t && i < t->nseconds; i++) {
+		e = t->seconds[i].e;
+		for (s = first; s <= last && !bit_test(e->second, s); s++)
+			;
+		if (s > last)
+			continue;
+		if (e->tz != z || !now.tm_mday) { /*- the minute in the time of the zone */
+			z = e->tz;
+			off = z ? zone_offset(z, StartTime) : GMToff;
+			tt = vtime * SECONDS_PER_MINUTE - GMToff + off;
+			gmtime_r(&tt, &now);
+			tt += SECONDS_PER_DAY;
+			gmtime_r(&tt, &tom);
+		}
+		if (bit_test(e->minute, now.tm_min - FIRST_MINUTE) && bit_test(e->hour, now.tm_hour - FIRST_HOUR) &&
+				bit_test(e->month, now.tm_mon + 1 - FIRST_MONTH) &&
+				day_match(e, now.tm_year + 1900, now.tm_yday, now.tm_mday - FIRST_DOM,
+					now.tm_wday - FIRST_DOW, tom.tm_mday == 1))
+			job_add(e, t->seconds[i].u, vtime * SECONDS_PER_MINUTE - GMToff + s);
+	}
+}
+
+/*-
+ * the time on the monotonic clock in nanoseconds. @every entries are
+ * scheduled on this clock, so that they keep their interval when the
+ * wall clock is stepped or changes for DST.
+ */
+static int64_t
+mono_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*-
+ * queue @every entries which are due and move each to its next run.
+ * an entry that is more than one interval late (svcron was busy) runs
+ * once and then continues at its next interval, keeping its phase.
+ */
 static void
-find_jobs(int vtime, cron_db *db, int doWild, int doNonWild)
+every_jobs(cron_db *db)
 {
-	const time_t    virtualSecond = vtime * SECONDS_PER_MINUTE;
-	const time_t    virtualTomorrow = virtualSecond + SECONDS_PER_DAY;
+	const sched_table *t = db->tab;
 	entry          *e;
-	const user     *u;
+	int64_t         now = mono_now(), step;
+	int             i;
+
+	everyNext = 0;
+	for (i = 0; t && i < t->nevery; i++) {
+		e = t->every[i].e;
+		if (e->due <= now) {
+			job_add(e, t->every[i].u, StartTime - (time_t) ((now - e->due) / 1000000000));
+			step = (int64_t) e->every * 1000000000;
+			e->due += ((now - e->due) / step + 1) * step;
+		}
+		if (!everyNext || e->due < everyNext)
+			everyNext = e->due;
+	}
+}
+
+/*-
+ * after the database changed, build its schedule table, collect the
+ * seconds used by entries with a seconds field, and place new @every
+ * entries on the monotonic clock. the first run of an @every
+ * entry is at a time of the wall clock which is a multiple of its
+ * interval plus its phase, so that it runs at the same times after a
+ * restart or reload. from then on it only follows the monotonic clock.
+ */
+static void
+set_timers(cron_db *db)
+{
+	const sched_table *tab;
+	entry          *e;
+	struct timespec wall;
+	int64_t         mono;
+	time_t          t;
+	int             i, k;
+
+	if (db->tab)
+		return;	/*- nothing changed */
+	sched_build(db);
+	tab = db->tab;
+	bit_nclear(secondMask, 0, SECOND_COUNT - 1);
+	for (i = 0; i < tab->nseconds; i++) {
+		for (k = 0; k < bitstr_size(SECOND_COUNT); k++)
+			secondMask[k] |= tab->seconds[i].e->second[k];
+	}
+	everyNext = 0;
+	mono = mono_now();
+	clock_gettime(CLOCK_REALTIME, &wall);
+	for (i = 0; i < tab->nevery; i++) {
+		e = tab->every[i].e;
+		if (!e->due) {
+			t = wall.tv_sec + GMToff - e->phase;
+			t = t - t % e->every + e->every + e->phase - GMToff;
+			e->due = mono + (int64_t) (t - wall.tv_sec) * 1000000000 - wall.tv_nsec;
+		}
+		if (!everyNext || e->due < everyNext)
+			everyNext = e->due;
+	}
+	bit_clear(secondMask, 0);
+	bit_ffs(secondMask, SECOND_COUNT, &k);
+	secondsUsed = (k != -1);
+}
+
+/*-
+ * start the jobs due in the local minute vtime ahead of time. they are
+ * held back until barrier_release() at the minute, and are not queued
+ * again by find_jobs() then.
+ */
+static void
+prewarm_jobs(cron_db *db, int vtime)
+{
+	zone           *z;
+	time_t          t = vtime * SECONDS_PER_MINUTE - GMToff;
+	long            off;
+
+	find_jobs(vtime, vtime, db, NULL, GMToff, TRUE, TRUE);
+	for (z = zone_next(NULL); z; z = zone_next(z)) {
+		off = zone_offset(z, t);
+		find_jobs((int) ((t + off) / SECONDS_PER_MINUTE), (int) ((t + off) / SECONDS_PER_MINUTE), db, z, off, TRUE, TRUE);
+	}
+	job_prewarm();
+}
+
+/*-
+ * true if e was due in any of the minutes first to last. goes day by
+ * day, so that long periods of downtime are cheap to look at.
+ */
+static bool
+was_due(const entry *e, int first, int last)
+{
+	time_t          t;
 	struct tm       now = {0}, tom = {0};
+	int             day, h, m, vtime;
+
+	for (day = first - first % (HOUR_COUNT * MINUTE_COUNT); day <= last; day += HOUR_COUNT * MINUTE_COUNT) {
+		t = day * SECONDS_PER_MINUTE;
+		gmtime_r(&t, &now);
+		t += SECONDS_PER_DAY;
+		gmtime_r(&t, &tom);
+		if (!bit_test(e->month, now.tm_mon + 1 - FIRST_MONTH) ||
+				!day_match(e, now.tm_year + 1900, now.tm_yday, now.tm_mday - FIRST_DOM,
+					now.tm_wday - FIRST_DOW, tom.tm_mday == 1))
+			continue;
+		for (h = 0; h < HOUR_COUNT; h++) {
+			if (!bit_test(e->hour, h))
+				continue;
+			for (m = 0; m < MINUTE_COUNT; m++) {
+				vtime = day + h * MINUTE_COUNT + m;
+				if (bit_test(e->minute, m) && vtime >= first && vtime <= last)
+					return (TRUE);
+			}
+		}
+	}
+	return (FALSE);
+}
 
-	gmtime_r(&virtualSecond, &now);
-	gmtime_r(&virtualTomorrow, &tom);
-	/*- make 0-based values out of these so we can use them as indicies */
-	const int       minute = now.tm_min - FIRST_MINUTE;
-	const int       hour = now.tm_hour - FIRST_HOUR;
-	const int       dom = now.tm_mday - FIRST_DOM;
-	const int       month = now.tm_mon + 1 /* 0..11 -> 1..12 */  - FIRST_MONTH;
-	const int       dow = now.tm_wday - FIRST_DOW;
+/*-
+ * queue entries of zone z with CRON_CATCHUP that were due at least once
+ * between the time recorded in the journal and the time until, i.e.
+ * while svcron was not running or time jumped forward. each runs only
+ * once.
+ */
+static void
+catchup_jobs(cron_db *db, zone *z, time_t until)
+{
+	entry          *e;
+	const user     *u;
+	time_t          t;
+	long            off = z ? zone_offset(z, until) : GMToff;
+	int             last = (int) ((until + off) / SECONDS_PER_MINUTE);
 
-	/*
-	 * the dom/dow situation is odd. '* * 1,15 * Sun' will run on the
-	 * first and fifteenth AND every Sunday; '* * * * Sun' will run *only*
-	 * on Sundays; '* * 1,15 * *' will run *only* the 1st and 15th. this
-	 * is why we keep 'e->dow_star' and 'e->dom_star'. yes, it's bizarre.
-	 * like many bizarre things, it's the standard.
-	 */
-	const bool      is_lastdom = (tom.tm_mday == 1);
 	for (u = db->head; u != NULL; u = u->next) {
 		for (e = u->crontab; e != NULL; e = e->next) {
-			bool            thisdom = bit_test(e->dom, dom) || (is_lastdom && (e->flags & DOM_LAST) != 0);
-			bool            thisdow = bit_test(e->dow, dow);
-			if (bit_test(e->minute, minute) && bit_test(e->hour, hour) &&
-					bit_test(e->month, month) &&
-					((e->flags & (DOM_STAR | DOW_STAR)) != 0 ? (thisdom && thisdow) : (thisdom || thisdow))) {
-				if ((doNonWild && (e->flags & (MIN_STAR | HR_STAR)) == 0) || (doWild && (e->flags & (MIN_STAR | HR_STAR)) != 0))
-					job_add(e, u);
-			}
+			if (!(e->flags & CATCHUP) || (e->flags & WHEN_REBOOT) || e->tz != z || !(t = journal_last(e->hash)))
+				continue;
+			if (was_due(e, (int) ((t + off) / SECONDS_PER_MINUTE) + 1, last))
+				job_catchup(e, u, last * SECONDS_PER_MINUTE - off);
 		}
 	}
 }
@@ -305,9 +715,14 @@ static void
 set_time(int initialize)
 {
 	struct tm       tm;
+	struct timespec ts;
 	static int      isdst;
 
 	StartTime = time(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	clockMono = ts.tv_sec;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	clockBoot = ts.tv_sec;
 
 	/*
 	 * We adjust the time to GMT so we can catch DST changes. 
@@ -321,18 +736,83 @@ set_time(int initialize)
 }
 
 /*
- * Try to just hit the next minute.
+ * Try to just hit the next minute, or the next second used by an entry
+ * with a seconds field, the next @every run, the next try of a job
+ * which could not be started or the release of a job held back by
+ * RANDOM_DELAY or the rate limit if that comes first. while a reload is
+ * under way, don't sleep at all. when jobs started ahead wait for the
+ * minute, sleep until the minute starts on the wall clock and release
+ * them then.
  */
 static void
 cron_sleep(int target)
 {
-	time_t          t1, t2;
-	int             seconds_to_wait;
-
-	t1 = time(NULL) + GMToff;
-	seconds_to_wait = (int) (target * SECONDS_PER_MINUTE - t1) + 1;
+	time_t          t1, t2, retry;
+	struct timespec ts, now;
+	int64_t         ns;
+	int             seconds_to_wait, s, minute;
+
+	if (reloading)
+		return;
+	clock_gettime(CLOCK_REALTIME, &now);
+	t1 = now.tv_sec + GMToff;
+	seconds_to_wait = (int) (target * SECONDS_PER_MINUTE - t1);
+	if (secondsUsed) {
+		for (s = (int) (t1 % SECONDS_PER_MINUTE) + 1; s < SECOND_COUNT && !bit_test(secondMask, s); s++)
+			;
+		if (s < SECOND_COUNT && s - t1 % SECONDS_PER_MINUTE < seconds_to_wait)
+			seconds_to_wait = (int) (s - t1 % SECONDS_PER_MINUTE);
+	}
+	if (warmSecond > t1 % SECONDS_PER_MINUTE && warmSecond - t1 % SECONDS_PER_MINUTE < seconds_to_wait)
+		seconds_to_wait = (int) (warmSecond - t1 % SECONDS_PER_MINUTE);
+	if ((retry = job_retry_at()) && retry + GMToff - t1 < seconds_to_wait)
+		seconds_to_wait = (int) (retry + GMToff - t1);
 	while (seconds_to_wait > 0 && seconds_to_wait < 65) {
-		sleep((unsigned int) seconds_to_wait);
+		/*-
+		 * sleep on the boot clock, which keeps running while the
+		 * system is suspended, so that we wake up right after a
+		 * resume rather than sleeping for the rest of the minute.
+		 * the fraction of the current second is taken off so that
+		 * we wake up just after the second starts, and jobs with
+		 * seconds do not drift.
+		 */
+		ts.tv_sec = seconds_to_wait - 1;
+		ts.tv_nsec = 1000000000 - now.tv_nsec + 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		minute = seconds_to_wait == (int) (target * SECONDS_PER_MINUTE - t1);
+		if (everyNext) {
+			if ((ns = everyNext - mono_now()) <= 0)
+				break;
+			if (ns < (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec) {
+				ts.tv_sec = ns / 1000000000;
+				ts.tv_nsec = ns % 1000000000;
+				minute = 0;
+			}
+		}
+		if ((ns = job_release_at())) {
+			if ((ns -= (int64_t) now.tv_sec * 1000000000 + now.tv_nsec) <= 0)
+				break;
+			if (ns < (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec) {
+				ts.tv_sec = ns / 1000000000;
+				ts.tv_nsec = ns % 1000000000;
+				minute = 0;
+			}
+		}
+		if (minute && barrier_held()) {
+			ts.tv_sec = target * SECONDS_PER_MINUTE - GMToff;
+			ts.tv_nsec = 0;
+			if (!clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL))
+				barrier_release();
+		} else {
+#ifdef HAVE_BOOTTIME
+			(void) clock_nanosleep(CLOCK_BOOTTIME, 0, &ts, NULL);
+#else
+			(void) nanosleep(&ts, NULL);
+#endif
+		}
 		/*
 		 * Check to see if we were interrupted by a signal.
 		 * If so, service the signal(s) then continue sleeping
@@ -343,8 +823,14 @@ cron_sleep(int target)
 		if (got_sigchld) {
 			got_sigchld = 0;
 			sigchld_reaper("child", NULL);
+			job_runqueue(); /*- start waiting catch-up jobs */
 		}
-		t2 = time(NULL) + GMToff;
+		if (got_sigusr1) {
+			got_sigusr1 = 0;
+			job_stats();
+		}
+		clock_gettime(CLOCK_REALTIME, &now);
+		t2 = now.tv_sec + GMToff;
 		seconds_to_wait -= (int) (t2 - t1);
 		t1 = t2;
 	}
@@ -362,6 +848,12 @@ sigchld_handler(int x)
 	got_sigchld = 1;
 }
 
+static void
+sigusr1_handler(int x)
+{
+	got_sigusr1 = 1;
+}
+
 static void
 quit(int x)
 {
@@ -373,9 +865,9 @@ quit(int x)
 static void
 parse_args(int argc, char *argv[])
 {
-	int             argch;
+	int             argch, i;
 
-	while (-1 != (argch = getopt(argc, argv, "vM:d:"))) {
+	while (-1 != (argch = getopt(argc, argv, "vRM:d:c:l:b:a:p:"))) {
 		switch (argch)
 		{
 		default:
@@ -383,6 +875,9 @@ parse_args(int argc, char *argv[])
 		case 'v':
 			verbose = 1;
 			break;
+		case 'R':
+			RebootAlways = 1;
+			break;
 		case 'M':
 			if (strlen(optarg) == 0)
 				usage();
@@ -391,6 +886,25 @@ parse_args(int argc, char *argv[])
 		case 'd':
 			dbdir = optarg;
 			break;
+		case 'c':
+			CgroupRoot = optarg;
+			break;
+		case 'l':
+			if (!(i = scan_uint(optarg, &LaunchRate)) || optarg[i])
+				usage();
+			break;
+		case 'b':
+			if (!(i = scan_uint(optarg, &LaunchBurst)) || optarg[i])
+				usage();
+			break;
+		case 'a':
+			if (!(i = scan_uint(optarg, &CatchupMax)) || optarg[i])
+				usage();
+			break;
+		case 'p':
+			if (!(i = scan_uint(optarg, &PrewarmLead)) || optarg[i] || PrewarmLead >= SECONDS_PER_MINUTE)
+				usage();
+			break;
 		}
 	}
 }
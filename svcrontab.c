@@ -596,15 +596,18 @@ replace_cmd(void)
 			eof = TRUE;
 			break;
 		case FALSE:
-			e = load_entry(tmp, check_error, pw, envp);
+			e = load_entry(tmp, check_error, pw, envp, NULL);
 			if (e)
 				free(e);
 			break;
 		case TRUE:
+			if (!(envp = myenv_set(envp, envstr)))
+				die_nomem(FATAL);
 			break;
 		}
 	}
 
+	calendar_flush();
 	if (CheckErrorCount != 0) {
 		strerr_warn2(WARN, "errors in crontab file, can't install.", 0);
 		fclose(tmp);
@@ -22,17 +22,60 @@
 static char     rcsid[] = "$Id: user.c,v 1.2 2024-06-12 23:58:55+05:30 Cprogrammer Exp mbhangui $";
 #endif
 
+#define FATAL "svcron: fatal: "
+
 void
 free_user(user *u)
 {
 	entry          *e, *ne;
+	arena           mem;
 
-	free(u->name);
+	job_forget(u); /*- catch-up jobs may still refer to u */
 	for (e = u->crontab; e != NULL; e = ne) {
 		ne = e->next;
 		free_entry(e);
 	}
-	free(u);
+	mem = u->mem; /*- u itself is in the arena */
+	arena_free(&mem);
+}
+
+static int
+hash_cmp(const void *a, const void *b)
+{
+	uint64_t        x = (*(entry * const *) a)->hash, y = (*(entry * const *) b)->hash;
+
+	return (x < y ? -1 : x > y);
+}
+
+/*-
+ * nu is a new version of the crontab of old. entries which are in
+ * both, going by their hash, keep what is known about them at run
+ * time: the next run of @every, a run started ahead by svcron -p and
+ * jobs waiting on the catch-up and retry queues.
+ */
+void
+carry_user(const user *old, user *nu)
+{
+	entry          *e, **v, **p;
+	size_t          n = 0;
+
+	for (e = old->crontab; e != NULL; e = e->next)
+		n++;
+	if (!n)
+		return;
+	if (!(v = (entry **) malloc(n * sizeof (entry *))))
+		die_nomem(FATAL);
+	for (n = 0, e = old->crontab; e != NULL; e = e->next)
+		v[n++] = e;
+	qsort(v, n, sizeof (entry *), hash_cmp);
+	for (e = nu->crontab; e != NULL; e = e->next) {
+		if (!(p = (entry **) bsearch(&e, v, n, sizeof (entry *), hash_cmp)))
+			continue;
+		e->due = (*p)->due;
+		e->warm = (*p)->warm;
+	}
+	free(v);
+	job_rebind(old, nu);
 }
 
 user           *
@@ -41,7 +84,8 @@ load_user(int crontab_fd, struct passwd *pw, const char *name)
 	char           *envstr;
 	FILE           *file;
 	user           *u;
-	entry          *e;
+	entry          *e, **tail;
+	arena           mem = { 0 };
 	int             status, save_errno;
 	char          **envp, **tenvp;
 
@@ -50,22 +94,25 @@ load_user(int crontab_fd, struct passwd *pw, const char *name)
 		return (NULL);
 	}
 
-	/*- file is open.  build user entry, then read the crontab file.  */
-	if ((u = (user *) malloc(sizeof (user))) == NULL)
-		return (NULL);
-	if ((u->name = strdup(name)) == NULL) {
+	/*-
+	 * file is open.  build user entry, then read the crontab file.
+	 * the user entry and the crontab are allocated from one arena.
+	 */
+	if ((u = (user *) arena_alloc(&mem, sizeof (user))) == NULL ||
+			(u->name = arena_strdup(&mem, name)) == NULL) {
 		save_errno = errno;
-		free(u);
+		arena_free(&mem);
 		errno = save_errno;
 		return (NULL);
 	}
+	u->mem = mem; /*- from now on allocate through u */
 	u->crontab = NULL;
+	tail = &u->crontab;
 
 	/*- init environment.  this will be copied/augmented for each entry.  */
 	if ((envp = myenv_init()) == NULL) {
 		save_errno = errno;
-		free(u->name);
-		free(u);
+		arena_free(&u->mem);
 		errno = save_errno;
 		return (NULL);
 	}
@@ -79,10 +126,10 @@ load_user(int crontab_fd, struct passwd *pw, const char *name)
 			u = NULL;
 			goto done;
 		case FALSE:
-			e = load_entry(file, NULL, pw, envp);
-			if (e) {
-				e->next = u->crontab;
-				u->crontab = e;
+			e = load_entry(file, NULL, pw, envp, &u->mem);
+			if (e) { /*- keep entries in file order */
+				*tail = e;
+				tail = &e->next;
 			}
 			break;
 		case TRUE:
@@ -99,6 +146,7 @@ load_user(int crontab_fd, struct passwd *pw, const char *name)
 	}
 
 done:
+	calendar_flush();
 	myenv_free(envp);
 	fclose(file);
 	return (u);
@@ -0,0 +1,155 @@
+/*
+ * $Id$
+ *
+ * time zones for CRON_TZ.
+ *
+ * Every zone named by CRON_TZ in a crontab is loaded once and shared by
+ * all entries using it. When a zone is loaded, its UTC offsets for the
+ * coming year are worked out with localtime_r() under TZ=zone and kept
+ * as a table of transitions, so that finding the offset of a zone for a
+ * given time is a short array lookup, without touching TZ again. The
+ * table is rebuilt when time runs past its end.
+ */
+#include <env.h>
+#include <stralloc.h>
+#include "cron.h"
+
+#if !defined(lint) && !defined(LINT)
+static char     rcsid[] = "$Id$";
+#endif
+
+#define FATAL "svcron: fatal: "
+
+#define ZONE_SPAN (400 * SECONDS_PER_DAY) /*- time covered by the table */
+
+static zone    *zones;
+
+static long
+offset_at(time_t t)
+{
+	struct tm       tm;
+
+	localtime_r(&t, &tm);
+	return (get_gmtoff(&t, &tm));
+}
+
+/*
+ * build the transition table of z for ZONE_SPAN from a day before
+ * from. TZ is switched to the zone while doing this and restored after.
+ */
+static void
+zone_load(zone *z, time_t from)
+{
+	static char    *deftz;
+	static int      saved;
+	time_t          t, lo, hi, mid, end;
+	long            off;
+
+	if (!saved) {
+		if ((deftz = env_get("TZ")) && !(deftz = strdup(deftz)))
+			die_nomem(FATAL);
+		saved = 1;
+	}
+	if (!env_put2("TZ", z->name))
+		die_nomem(FATAL);
+	tzset();
+	t = from - SECONDS_PER_DAY;
+	z->at[0] = t;
+	z->off[0] = offset_at(t);
+	z->ntrans = 1;
+	for (end = t + ZONE_SPAN; t < end && z->ntrans < ZONE_TRANS; t += SECONDS_PER_HOUR) {
+		if ((off = offset_at(t + SECONDS_PER_HOUR)) == z->off[z->ntrans - 1])
+			continue;
+		/*- the offset changed within this hour, find the second */
+		for (lo = t, hi = t + SECONDS_PER_HOUR; hi - lo > 1;) {
+			mid = lo + (hi - lo) / 2;
+			if (offset_at(mid) == off)
+				hi = mid;
+			else
+				lo = mid;
+		}
+		z->at[z->ntrans] = hi;
+		z->off[z->ntrans++] = off;
+	}
+	z->until = t;
+	if (deftz ? !env_put2("TZ", deftz) : !env_unset("TZ"))
+		die_nomem(FATAL);
+	tzset();
+}
+
+/*- offset from UTC in seconds of zone z at time t */
+long
+zone_offset(zone *z, time_t t)
+{
+	int             i;
+
+	if (t >= z->until || t < z->at[0])
+		zone_load(z, t);
+	for (i = z->ntrans - 1; i > 0 && t < z->at[i]; i--)
+		;
+	return (z->off[i]);
+}
+
+/*
+ * return the zone called name, loading it if not in use yet. returns
+ * NULL if there is no such zone.
+ */
+zone           *
+zone_get(const char *name)
+{
+	zone           *z;
+	static stralloc path = { 0 };
+
+	for (z = zones; z; z = z->next) {
+		if (!strcmp(z->name, name)) {
+			z->refs++;
+			return (z);
+		}
+	}
+	/*- TZ would silently fall back to UTC for a zone it doesn't know */
+	if (!*name || *name == '/' || strstr(name, ".."))
+		return (NULL);
+	if (!stralloc_copys(&path, _PATH_ZONEINFO "/") || !stralloc_cats(&path, name) || !stralloc_0(&path))
+		die_nomem(FATAL);
+	if (access(path.s, R_OK) == -1)
+		return (NULL);
+	if (!(z = (zone *) calloc(1, sizeof (zone))) || !(z->name = strdup(name)))
+		die_nomem(FATAL);
+	z->refs = 1;
+	zone_load(z, time(NULL));
+	z->next = zones;
+	zones = z;
+	return (z);
+}
+
+void
+zone_put(zone *z)
+{
+	zone          **zp;
+
+	if (!z || --z->refs)
+		return;
+	for (zp = &zones; *zp != z; zp = &(*zp)->next)
+		;
+	*zp = z->next;
+	free(z->name);
+	free(z);
+}
+
+/*- iterate over the zones in use, starting with zone_next(NULL) */
+zone           *
+zone_next(zone *z)
+{
+	return (z ? z->next : zones);
+}
+
+void
+getversion_zone_c()
+{
+	const char     *x = rcsid;
+	x++;
+}
+
+/*-
+ * $Log$
+ */